@@ -0,0 +1,194 @@
+#include "autotuner.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QString>
+#include <QSysInfo>
+
+#include <fstream>
+#include <sstream>
+
+/*
+ * The model of the CPU, or its architecture if the model can
+ * not be read
+ */
+static std::string cpuModel() {
+#if defined(__linux__)
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos && colon + 2 <= line.size()) {
+                return line.substr(colon + 2);
+            }
+        }
+    }
+#elif defined(_WIN32)
+    QSettings processor(
+                "HKEY_LOCAL_MACHINE\\HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0",
+                QSettings::NativeFormat);
+    QString model = processor.value("ProcessorNameString").toString().trimmed();
+    if (!model.isEmpty()) {
+        return model.toStdString();
+    }
+#endif
+    return QSysInfo::currentCpuArchitecture().toStdString();
+}
+
+Autotuner::Autotuner(const Size &size, int runs) :
+    size(size),
+    runs(max(runs, 1))
+{
+}
+
+ImagePyramid::Tuning Autotuner::tune() {
+
+    // smoothed noise, so the layers are not all detail
+    RNG rng(0x5eed);
+    image1.create(size, CV_8UC3);
+    image2.create(size, CV_8UC3);
+    rng.fill(image1, RNG::UNIFORM, 0, 256);
+    rng.fill(image2, RNG::UNIFORM, 0, 256);
+    GaussianBlur(image1, image1, Size(5, 5), 0);
+    GaussianBlur(image2, image2, Size(5, 5), 0);
+
+    // the default gradient of the command line
+    mask = BlendMask::linearGradient(
+                size,
+                Point2f(size.width * 0.4f, 0),
+                Point2f(size.width * 0.6f, 0));
+
+    results.clear();
+    ImagePyramid::Tuning candidate = ImagePyramid::defaultTuning();
+    best = measure(candidate);
+
+    // threads, which change building and blending
+    // powers of two up to the number of CPUs, and all of them
+    std::vector<int> threadCounts;
+    int cpus = getNumberOfCPUs();
+    for (int threads = 1; threads < cpus; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cpus);
+
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        candidate = best.tuning;
+        candidate.threads = threadCounts[i];
+
+        Result result = measure(candidate);
+        if (result.buildSeconds + result.blendSeconds <
+                best.buildSeconds + best.blendSeconds) {
+            best = result;
+        }
+    }
+
+    // the kernel and the tile size, which only change blending
+    const ImagePyramid::BlendKernel kernels[] = {
+        ImagePyramid::BLEND_KERNEL_PIXEL,
+        ImagePyramid::BLEND_KERNEL_EXPANDED
+    };
+    const int tileSizes[] = {16, 32, 64, 128};
+    ImagePyramid::Tuning base = best.tuning;
+
+    for (int k = 0; k < 2; k++) {
+        for (int t = 0; t < 4; t++) {
+            candidate = base;
+            candidate.blendKernel = kernels[k];
+            candidate.maskTileSize = tileSizes[t];
+
+            Result result = measure(candidate);
+            if (result.blendSeconds < best.blendSeconds) {
+                best = result;
+            }
+        }
+    }
+
+    // the tile rows per stripe, 0 blends on one thread
+    const int stripeTiles[] = {0, 1, 2, 4, 8, 16};
+    base = best.tuning;
+
+    for (int s = 0; s < 6; s++) {
+        candidate = base;
+        candidate.stripeTiles = stripeTiles[s];
+
+        Result result = measure(candidate);
+        if (result.blendSeconds < best.blendSeconds) {
+            best = result;
+        }
+    }
+
+    ImagePyramid::setTuning(best.tuning);
+
+    // the images and pyramids are only needed while tuning
+    image1.release();
+    image2.release();
+    pyr1 = ImagePyramid();
+    pyr2 = ImagePyramid();
+    blended = ImagePyramid();
+
+    return best.tuning;
+}
+
+std::string Autotuner::defaultProfilePath() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)
+            .toStdString() + "/tuning-" + QSysInfo::machineHostName().toStdString() + ".yml";
+}
+
+std::string Autotuner::machineName() {
+    std::ostringstream name;
+    name << QSysInfo::machineHostName().toStdString() << ", "
+         << cpuModel() << ", " << getNumberOfCPUs() << " CPUs";
+    return name.str();
+}
+
+int Autotuner::applyProfile(const std::string &path, bool retune) {
+
+    std::string machine = machineName();
+    if (!retune) {
+        return ImagePyramid::loadTuning(path, machine) == 0 ? 0 : 3;
+    }
+
+    Autotuner tuner;
+    tuner.tune();
+
+    QFileInfo(QString::fromStdString(path)).absoluteDir().mkpath(".");
+    return ImagePyramid::saveTuning(path, machine) == 0 ? 1 : 2;
+}
+
+Autotuner::Result Autotuner::measure(const ImagePyramid::Tuning &tuning) {
+
+    ImagePyramid::setTuning(tuning);
+
+    Result result;
+    result.tuning = ImagePyramid::getTuning();
+    result.buildSeconds = 0;
+    result.blendSeconds = 0;
+
+    // the first run allocates and warms the caches, it is not
+    // timed
+    for (int run = 0; run <= runs; run++) {
+        int64 start = getTickCount();
+        pyr1.setImage(image1);
+        pyr2.setImage(image2);
+        double buildSeconds = (getTickCount() - start) / getTickFrequency();
+
+        start = getTickCount();
+        blended.blendFused(pyr1, pyr2, mask);
+        double blendSeconds = (getTickCount() - start) / getTickFrequency();
+
+        if (run == 1) {
+            result.buildSeconds = buildSeconds;
+            result.blendSeconds = blendSeconds;
+        }
+        else if (run > 1) {
+            result.buildSeconds = min(result.buildSeconds, buildSeconds);
+            result.blendSeconds = min(result.blendSeconds, blendSeconds);
+        }
+    }
+
+    results.push_back(result);
+    return result;
+}
@@ -0,0 +1,118 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <vector>
+
+#include "blendmask.h"
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The Autotuner class finds the ImagePyramid::Tuning that
+ * builds and blends fastest on the machine it runs on.
+ *
+ * It times building and blending a synthetic image with each
+ * candidate setting, one setting at a time: first the number of
+ * threads, then the blend kernel with the mask tile size, then
+ * the number of tile rows per blend stripe. The tuning does not
+ * change the result, so only the time is compared. The pyramid
+ * filter does change the result and is not tuned.
+ *
+ * The tuning is saved to a profile, which later runs load with
+ * applyProfile instead of tuning again. The profile records the
+ * machine it was made on, and is only loaded on that machine.
+ * Tuning takes a while, so it is only done when asked for.
+ */
+class Autotuner
+{
+public:
+    /**
+     * @brief The Result struct is the time of one candidate, the
+     * fastest of the runs
+     */
+    struct Result {
+        ImagePyramid::Tuning tuning;
+        double buildSeconds;    // building the pyramids of both images
+        double blendSeconds;    // blending and reconstructing
+    };
+
+    /**
+     * @brief Autotuner creates a tuner
+     * @param size the size of the synthetic image, about the size
+     * of the images the machine blends
+     * @param runs the number of timed runs of each candidate
+     */
+    explicit Autotuner(const Size &size = Size(1536, 1024), int runs = 3);
+
+    /**
+     * @brief tune times the candidates and sets the fastest as
+     * the tuning of all pyramids
+     * @return the fastest tuning
+     */
+    ImagePyramid::Tuning tune();
+    /**
+     * @brief getResults gets the time of every candidate of the
+     * last tune, the first is the default tuning
+     * @return the results in the order they were timed
+     */
+    const std::vector<Result> &getResults() const {return results;}
+    /**
+     * @brief getBest gets the result of the tuning chosen by the
+     * last tune
+     * @return the result
+     */
+    const Result &getBest() const {return best;}
+
+    /**
+     * @brief defaultProfilePath gets the path of the profile of
+     * the user on this machine. The name includes the host name,
+     * so machines sharing the home directory have their own.
+     * @return the path
+     */
+    static std::string defaultProfilePath();
+    /**
+     * @brief machineName names this machine for the profile: the
+     * host name, the CPU model and the number of CPUs
+     * @return the name
+     */
+    static std::string machineName();
+    /**
+     * @brief applyProfile loads a profile, or tunes and saves the
+     * profile if retune is set. The default tuning is kept if the
+     * profile can not be loaded or was made on another machine.
+     * @param path the path of the profile
+     * @param retune true to tune instead of loading the profile
+     * @return 0 if loaded, 1 if tuned and saved, 2 if tuned but
+     * the profile could not be saved, 3 if not loaded
+     */
+    static int applyProfile(const std::string &path, bool retune = false);
+
+private:
+    Size size;
+    int runs;
+
+    Mat image1;
+    Mat image2;
+    BlendMask mask;
+
+    // reused, so only the first run of each candidate allocates
+    ImagePyramid pyr1;
+    ImagePyramid pyr2;
+    ImagePyramid blended;
+
+    std::vector<Result> results;
+    Result best;
+
+    /**
+     * @brief measure times building and blending with a tuning
+     * @param tuning the tuning, set while timing
+     * @return the fastest times of the runs
+     */
+    Result measure(const ImagePyramid::Tuning &tuning);
+};
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,168 @@
+#include "backgroundblender.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+BackgroundBlender::BackgroundBlender() :
+    workers(max(getNumberOfCPUs(), 1)),
+    backgroundSeconds(0),
+    maskSeconds(0),
+    nextJob(0),
+    failed(0),
+    jobs(0),
+    seconds(0)
+{
+    std::fill(stageSeconds, stageSeconds + STAGES, 0.0);
+}
+
+int BackgroundBlender::setBackground(const std::string &path, int layers) {
+
+    mask = BlendMask();
+    maskSeconds = 0;
+
+    int64 start = getTickCount();
+
+    Mat image = imread(path, IMREAD_COLOR);
+    if (image.empty()) {
+        background = ImagePyramid();
+        return 1;
+    }
+
+    background.setImage(image);
+    if (layers > 0 && background.setLayers(layers) != 0) {
+        background = ImagePyramid();
+        return 2;
+    }
+
+    // only the layers are read from here on
+    background.setLean(true);
+
+    backgroundSeconds = (getTickCount() - start) / getTickFrequency();
+
+    return 0;
+}
+
+int BackgroundBlender::setMask(const BlendMask &mask) {
+
+    if (background.getLayers() == 0) {
+        return 1;
+    }
+    if (mask.getSize() != background.getSize()) {
+        return 2;
+    }
+
+    int64 start = getTickCount();
+
+    // computed here, so the copies the workers make share them
+    this->mask = mask;
+    this->mask.setLevels(background.getLayers());
+
+    maskSeconds = (getTickCount() - start) / getTickFrequency();
+
+    return 0;
+}
+
+int BackgroundBlender::run(const std::vector<Job> &jobs) {
+
+    if (background.getLayers() == 0 || mask.empty()) {
+        return 1;
+    }
+
+    this->jobs = jobs.size();
+    nextJob = 0;
+    failed = 0;
+
+    // each worker adds up its own times
+    std::vector<double> busy(workers * STAGES, 0.0);
+
+    int64 start = getTickCount();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; i++) {
+        threads.push_back(std::thread(&BackgroundBlender::runWorker, this,
+                                      std::cref(jobs), &busy[i * STAGES]));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    seconds = (getTickCount() - start) / getTickFrequency();
+
+    std::fill(stageSeconds, stageSeconds + STAGES, 0.0);
+    for (int i = 0; i < workers; i++) {
+        for (int stage = 0; stage < STAGES; stage++) {
+            stageSeconds[stage] += busy[i * STAGES + stage];
+        }
+    }
+
+    return failed > 0 ? 2 : 0;
+}
+
+double BackgroundBlender::getSavedFraction() const {
+
+    if (jobs == 0) {
+        return 0;
+    }
+
+    double jobSeconds = 0;
+    for (int stage = 0; stage < STAGES; stage++) {
+        jobSeconds += stageSeconds[stage];
+    }
+
+    // every job would decode the background and build the
+    // background and mask pyramids itself
+    double shared = getSharedSeconds();
+    double unshared = jobs * shared + jobSeconds;
+
+    return unshared > 0 ? 1 - (shared + jobSeconds) / unshared : 0;
+}
+
+void BackgroundBlender::runWorker(const std::vector<Job> &jobs, double *busy) {
+
+    // Reused, so jobs of the background's size build into the
+    // level buffers of the last job. After the first job the
+    // foreground is built with the background's layers directly.
+    ImagePyramid foreground, blended;
+
+    Size size = background.getSize();
+    int layers = background.getLayers();
+
+    for (int job = nextJob++; job < (int) jobs.size(); job = nextJob++) {
+        try {
+            int64 start = getTickCount();
+            Mat image = imread(jobs[job].foreground, IMREAD_COLOR);
+            int64 decoded = getTickCount();
+            busy[DECODE] += (decoded - start) / getTickFrequency();
+
+            if (image.empty()) {
+                failed++;
+                continue;
+            }
+
+            // the foreground gets the size and layers of the
+            // background
+            if (image.size() != size) {
+                resize(image, image, size);
+            }
+            foreground.setImage(image);
+            foreground.setLayers(layers);
+            int64 built = getTickCount();
+            busy[BUILD] += (built - decoded) / getTickFrequency();
+
+            blended.blendFused(foreground, background, mask);
+            int64 blendedTime = getTickCount();
+            busy[BLEND] += (blendedTime - built) / getTickFrequency();
+
+            bool written = imwrite(jobs[job].output, blended.getImage());
+            busy[ENCODE] += (getTickCount() - blendedTime) / getTickFrequency();
+
+            if (!written) {
+                failed++;
+            }
+        }
+        catch (const cv::Exception &) {
+            failed++;
+        }
+    }
+}
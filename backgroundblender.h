@@ -0,0 +1,166 @@
+#ifndef BACKGROUNDBLENDER_H
+#define BACKGROUNDBLENDER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "blendmask.h"
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The BackgroundBlender class blends one background with
+ * many foregrounds using the same mask.
+ *
+ * The background is decoded and its pyramid built once, and the
+ * mask levels are computed once. Worker threads then take the
+ * foregrounds one at a time, each with its own foreground and
+ * result pyramids, and blend them with the background pyramid
+ * and the mask, which all workers read without copying. Nothing
+ * writes to the background or the mask while the workers run.
+ */
+class BackgroundBlender
+{
+public:
+    /**
+     * @brief The Job struct is one foreground and where its
+     * result is written
+     */
+    struct Job {
+        std::string foreground;
+        std::string output;
+    };
+
+    /**
+     * @brief The Stage enum is the work done for each job
+     */
+    enum Stage {
+        DECODE,
+        BUILD,      // building the pyramid of the foreground
+        BLEND,      // blending and reconstructing
+        ENCODE,
+        STAGES      // number of stages
+    };
+
+    /**
+     * @brief BackgroundBlender creates a blender with no
+     * background and one worker per CPU
+     */
+    BackgroundBlender();
+
+    /**
+     * @brief setBackground reads the background and builds its
+     * pyramid. Clears the mask.
+     * @param path the path of the background
+     * @param layers the number of layers, 0 for the maximum
+     * @return 0 if no error, 1 if it could not be read, 2 if
+     * the number of layers is not possible for its size
+     */
+    int setBackground(const std::string &path, int layers = 0);
+    /**
+     * @brief setMask sets the mask and computes its levels
+     * @param mask the mask for the foregrounds, 1 where only the
+     * foreground is used. Must be the size of the background
+     * pyramid.
+     * @return 0 if no error, 1 if there is no background, 2 if
+     * the mask is not the size of the background pyramid
+     */
+    int setMask(const BlendMask &mask);
+    /**
+     * @brief setWorkers sets the number of worker threads
+     * @param workers the number of workers, at least 1
+     */
+    void setWorkers(int workers) {this->workers = max(workers, 1);}
+
+    /**
+     * @brief getSize gets the size of the background pyramid,
+     * which the foregrounds are resized to
+     * @return the size
+     */
+    Size getSize() const {return background.getSize();}
+
+    /**
+     * @brief run blends every foreground with the background
+     * and writes the results
+     * @param jobs the foregrounds and outputs
+     * @return 0 if no error, 1 if there is no background or mask,
+     * 2 if some jobs failed
+     */
+    int run(const std::vector<Job> &jobs);
+
+    /* Results of the last run */
+    /**
+     * @brief getJobs gets the number of jobs run
+     * @return the number of jobs, including failed jobs
+     */
+    int getJobs() const {return jobs;}
+    /**
+     * @brief getFailed gets the number of jobs whose foreground
+     * could not be read or whose output could not be written
+     * @return the number of jobs
+     */
+    int getFailed() const {return failed;}
+    /**
+     * @brief getSeconds gets the time the run took
+     * @return the time in seconds
+     */
+    double getSeconds() const {return seconds;}
+    /**
+     * @brief getJobsPerSecond gets the throughput of the run
+     * @return jobs per second
+     */
+    double getJobsPerSecond() const
+    {return seconds > 0 ? jobs / seconds : 0;}
+    /**
+     * @brief getStageSeconds gets the time all workers spent in
+     * a stage
+     * @param stage the stage
+     * @return the time in seconds
+     */
+    double getStageSeconds(Stage stage) const {return stageSeconds[stage];}
+    /**
+     * @brief getSharedSeconds gets the time spent once for all
+     * jobs: decoding the background and building its pyramid,
+     * and computing the mask levels
+     * @return the time in seconds
+     */
+    double getSharedSeconds() const {return backgroundSeconds + maskSeconds;}
+    /**
+     * @brief getSavedFraction gets the part of the cost of the
+     * jobs saved by doing the shared work once, compared to
+     * doing it for every job
+     * @return the fraction, 0 if no jobs were run
+     */
+    double getSavedFraction() const;
+
+private:
+    // only read while the workers run
+    ImagePyramid background;
+    BlendMask mask;
+
+    int workers;
+
+    double backgroundSeconds;
+    double maskSeconds;
+
+    // the index of the next job a worker takes
+    std::atomic<int> nextJob;
+    std::atomic<int> failed;
+    int jobs;
+    double seconds;
+    double stageSeconds[STAGES];
+
+    /**
+     * @brief runWorker runs jobs until none are left
+     * @param jobs the jobs
+     * @param busy set to the time spent in each stage, STAGES
+     * values
+     */
+    void runWorker(const std::vector<Job> &jobs, double *busy);
+};
+
+#endif // BACKGROUNDBLENDER_H
@@ -0,0 +1,562 @@
+#include "batchrunner.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QString>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+/*
+ * Wall clock time in seconds, the same on every machine as long
+ * as their clocks agree
+ */
+static double now() {
+    return std::chrono::duration<double>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool fileExists(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file) {
+        fclose(file);
+    }
+    return file != NULL;
+}
+
+/*
+ * Writes "worker time" to a lease. With mode "wx" the lease is
+ * only written if it does not exist yet.
+ */
+static bool writeLease(const std::string &path, const char *mode,
+                       const std::string &worker, double time) {
+    FILE *file = fopen(path.c_str(), mode);
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "%s %.3f\n", worker.c_str(), time);
+    return fclose(file) == 0;
+}
+
+/*
+ * Replaces a file with another, in one step so readers see
+ * either the old or the new file
+ */
+static bool replaceFile(const std::string &from, const std::string &to) {
+#if defined(_WIN32)
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+/*
+ * Writes a new time to a lease through a temporary file, so the
+ * lease is never seen empty. A time in the past releases the
+ * lease early.
+ */
+static bool renewLease(const std::string &path, const std::string &worker, double time) {
+    std::string temp = path + "." + worker + ".tmp";
+    if (!writeLease(temp, "w", worker, time) || !replaceFile(temp, path)) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+BatchRunner::BatchRunner(const std::string &dir) :
+    dir(dir),
+    leaseTimeout(60),
+    layers(0),
+    stopping(false)
+{
+}
+
+int BatchRunner::runWorker(const std::string &worker) {
+
+    if (readManifest(dir, jobs) != 0) {
+        return 1;
+    }
+    if (!QDir().mkpath(QString::fromStdString(dir + "/leases")) ||
+            !QDir().mkpath(QString::fromStdString(dir + "/done"))) {
+        return 2;
+    }
+
+    currentLease.clear();
+    currentWorker = worker;
+    stopping = false;
+    std::thread heartbeatThread(&BatchRunner::heartbeat, this);
+
+    // the pyramids are reused, so jobs of the same size build
+    // into the level buffers of the last job
+    ImagePyramid pyr1, pyr2, blended;
+
+    // workers start at different jobs so they do not all race
+    // for the same leases
+    int count = jobs.size();
+    int offset = count > 0 ? std::hash<std::string>()(worker) % count : 0;
+
+    bool pending = true;
+    while (pending) {
+        pending = false;
+        bool claimed = false;
+
+        for (int i = 0; i < count; i++) {
+            int job = (offset + i) % count;
+            if (isDone(job)) {
+                continue;
+            }
+            pending = true;
+
+            std::string lease;
+            int attempt;
+            if (!claim(job, worker, lease, attempt)) {
+                continue;
+            }
+            claimed = true;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                currentLease = lease;
+            }
+
+            double start = now();
+            double megapixels = 0;
+            int result = runJob(jobs[job], pyr1, pyr2, blended, megapixels);
+            double end = now();
+
+            // A failure that may pass is retried by any worker,
+            // after a delay, until the last attempt. The lease is
+            // released without a result.
+            if (result == 2 && attempt + 1 < maxAttempts) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    currentLease.clear();
+                }
+                renewLease(lease, worker, now() - leaseTimeout + retryDelay);
+
+                std::cerr << "Job " << job << " failed on attempt " << attempt + 1
+                          << " of " << maxAttempts << ", it will be retried" << std::endl;
+                continue;
+            }
+
+            // The lease is renewed until the result is written,
+            // so no other worker runs the job again meanwhile
+            bool reported = false;
+            while (writeDone(job, worker, start, end, result == 0 ? megapixels : 0) != 0) {
+                if (!reported) {
+                    std::cerr << "Could not write " << donePath(job)
+                              << ", retrying" << std::endl;
+                    reported = true;
+                }
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                currentLease.clear();
+            }
+        }
+
+        // the jobs left are leased by other workers, wait for
+        // them to finish or for their leases to expire
+        if (pending && !claimed) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    heartbeatThread.join();
+
+    return 0;
+}
+
+BatchRunner::Progress BatchRunner::getProgress() const {
+
+    Progress progress = Progress();
+
+    std::vector<Job> manifest;
+    if (readManifest(dir, manifest) != 0) {
+        progress.jobs = -1;
+        return progress;
+    }
+    progress.jobs = manifest.size();
+
+    double first = 0, last = 0;
+
+    for (int job = 0; job < progress.jobs; job++) {
+        FILE *file = fopen(donePath(job).c_str(), "r");
+
+        if (!file) {
+            int attempt = latestAttempt(job);
+            if (attempt > 0 && !leaseExpired(leasePath(job, attempt - 1))) {
+                progress.leased++;
+            }
+            continue;
+        }
+
+        // "status worker start end megapixels"
+        char status[16], worker[256];
+        double start, end, megapixels;
+        int read = fscanf(file, "%15s %255s %lf %lf %lf",
+                          status, worker, &start, &end, &megapixels);
+        fclose(file);
+
+        progress.done++;
+        if (read != 5) {
+            continue;
+        }
+
+        if (std::string(status) != "ok") {
+            progress.failed++;
+        }
+        progress.megapixels += megapixels;
+        progress.jobsPerWorker[worker]++;
+
+        first = first == 0 ? start : min(first, start);
+        last = max(last, end);
+    }
+
+    progress.seconds = last - first;
+
+    return progress;
+}
+
+int BatchRunner::pinToCores(const std::vector<int> &cores) {
+
+    if (cores.empty()) {
+        return 1;
+    }
+
+#if defined(__linux__)
+    // threads started later get the same cores
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cores.size(); i++) {
+        CPU_SET(cores[i], &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        return 1;
+    }
+
+    // Prefer the memory of the node of the cores, so workers
+    // on different sockets use the memory bandwidth of each.
+    // Without libnuma, through the system call. Threads started
+    // later inherit the policy.
+    std::vector< std::vector<int> > nodes = numaNodes();
+
+    // the node with all the cores, -1 if they are on several
+    int coresNode = -1;
+    for (size_t node = 0; node < nodes.size(); node++) {
+        bool all = true;
+        for (size_t i = 0; i < cores.size() && all; i++) {
+            all = std::find(nodes[node].begin(), nodes[node].end(), cores[i]) !=
+                    nodes[node].end();
+        }
+        if (all) {
+            coresNode = node;
+        }
+    }
+    if (nodes.size() > 1 && coresNode >= 0 && coresNode < 63) {
+        unsigned long mask = 1UL << coresNode;
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8);
+    }
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i] < (int) sizeof(mask) * 8) {
+            mask |= (DWORD_PTR) 1 << cores[i];
+        }
+    }
+    if (mask == 0 || !SetProcessAffinityMask(GetCurrentProcess(), mask)) {
+        return 1;
+    }
+#else
+    return 1;
+#endif
+
+    setNumThreads((int) cores.size());
+    return 0;
+}
+
+std::vector< std::vector<int> > BatchRunner::numaNodes() {
+
+    std::vector< std::vector<int> > nodes;
+
+#if defined(__linux__)
+    std::string online;
+    std::ifstream onlineFile("/sys/devices/system/node/online");
+    if (std::getline(onlineFile, online)) {
+        std::vector<int> ids = parseCores(online);
+        for (size_t i = 0; i < ids.size(); i++) {
+            std::ostringstream path;
+            path << "/sys/devices/system/node/node" << ids[i] << "/cpulist";
+
+            // nodes with only memory have no cores
+            std::string list;
+            std::ifstream cpuList(path.str().c_str());
+            if (std::getline(cpuList, list) && !list.empty()) {
+                nodes.push_back(parseCores(list));
+            }
+        }
+    }
+#endif
+
+    if (nodes.empty()) {
+        std::vector<int> cores;
+        for (int core = 0; core < getNumberOfCPUs(); core++) {
+            cores.push_back(core);
+        }
+        nodes.push_back(cores);
+    }
+
+    return nodes;
+}
+
+std::vector<int> BatchRunner::parseCores(const std::string &list) {
+
+    std::vector<int> cores;
+
+    std::istringstream stream(list);
+    std::string part;
+    while (std::getline(stream, part, ',')) {
+        int first, last;
+        int read = sscanf(part.c_str(), "%d-%d", &first, &last);
+        if (read < 1) {
+            continue;
+        }
+        if (read == 1) {
+            last = first;
+        }
+        for (int core = first; core <= last; core++) {
+            cores.push_back(core);
+        }
+    }
+
+    return cores;
+}
+
+int BatchRunner::readManifest(const std::string &dir, std::vector<Job> &jobs) {
+
+    std::ifstream manifest((dir + "/manifest.txt").c_str());
+    if (!manifest) {
+        return 1;
+    }
+
+    jobs.clear();
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        // skip empty lines and comments
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 3) {
+            continue;
+        }
+
+        Job job = {fields[0], fields[1], fields[2], 40, 60};
+        if (fields.size() >= 5) {
+            job.startPercent = (float) atof(fields[3].c_str());
+            job.endPercent = (float) atof(fields[4].c_str());
+        }
+        jobs.push_back(job);
+    }
+
+    return 0;
+}
+
+int BatchRunner::writeDone(int job, const std::string &worker,
+                           double start, double end, double megapixels) const {
+
+    // written next to the marker and renamed, so readers never
+    // see half of it
+    std::string path = donePath(job);
+    std::string temp = path + "." + worker + ".tmp";
+
+    FILE *file = fopen(temp.c_str(), "w");
+    if (!file) {
+        return 1;
+    }
+    bool written = fprintf(file, "%s %s %.3f %.3f %.6f\n",
+                           megapixels > 0 ? "ok" : "failed", worker.c_str(),
+                           start, end, megapixels) > 0;
+    if (fclose(file) != 0 || !written) {
+        std::remove(temp.c_str());
+        return 1;
+    }
+
+    // another worker may have finished the job too, then its
+    // marker counts
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return isDone(job) ? 0 : 1;
+    }
+
+    return 0;
+}
+
+bool BatchRunner::claim(int job, const std::string &worker,
+                        std::string &lease, int &attempt) {
+
+    // the last attempt is still being worked on
+    attempt = latestAttempt(job);
+    if (attempt > 0 && !leaseExpired(leasePath(job, attempt - 1))) {
+        return false;
+    }
+
+    // only one worker can create the next attempt
+    lease = leasePath(job, attempt);
+    if (!writeLease(lease, "wx", worker, now())) {
+        return false;
+    }
+
+    // the job may have been finished since it was checked
+    return !isDone(job);
+}
+
+void BatchRunner::heartbeat() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!stopping) {
+        wake.wait_for(lock, std::chrono::seconds(max(leaseTimeout / 3, 1)));
+
+        if (!stopping && !currentLease.empty()) {
+            renewLease(currentLease, currentWorker, now());
+        }
+    }
+}
+
+int BatchRunner::runJob(const Job &job, ImagePyramid &pyr1,
+                        ImagePyramid &pyr2, ImagePyramid &blended,
+                        double &megapixels) {
+
+    megapixels = 0;
+
+    try {
+        // shared storage may not have the images yet, or fail
+        // to read them for a while
+        Mat image1 = imread(job.src1, IMREAD_COLOR);
+        Mat image2 = imread(job.src2, IMREAD_COLOR);
+        if (image1.empty() || image2.empty()) {
+            return 2;
+        }
+
+        // the second image uses the size of the first
+        if (image2.size() != image1.size()) {
+            resize(image2, image2, image1.size());
+        }
+
+        pyr1.setImage(image1);
+        pyr2.setImage(image2);
+        if (layers > 0) {
+            pyr1.setLayers(layers);
+            pyr2.setLayers(layers);
+        }
+
+        Size size = pyr1.getSize();
+        BlendMask mask = BlendMask::linearGradient(
+                    size,
+                    Point2f(size.width * job.startPercent / 100, 0),
+                    Point2f(size.width * job.endPercent / 100, 0));
+
+        blended.blendFused(pyr1, pyr2, mask);
+
+        // the output directory may be missing or full for a while
+        if (!imwrite(job.output, blended.getImage())) {
+            return 2;
+        }
+
+        megapixels = size.area() / 1e6;
+        return 0;
+    }
+    catch (const cv::Exception &e) {
+        // running out of memory may pass, other errors come
+        // from the job and happen again
+        return e.code == Error::StsNoMem ? 2 : 1;
+    }
+    catch (const std::bad_alloc &) {
+        return 2;
+    }
+}
+
+std::string BatchRunner::leasePath(int job, int attempt) const {
+    std::ostringstream path;
+    path << dir << "/leases/" << job << "." << attempt;
+    return path.str();
+}
+
+std::string BatchRunner::donePath(int job) const {
+    std::ostringstream path;
+    path << dir << "/done/" << job;
+    return path.str();
+}
+
+bool BatchRunner::isDone(int job) const {
+    return fileExists(donePath(job));
+}
+
+int BatchRunner::latestAttempt(int job) const {
+    int attempt = 0;
+    while (fileExists(leasePath(job, attempt))) {
+        attempt++;
+    }
+    return attempt;
+}
+
+bool BatchRunner::leaseExpired(const std::string &path) const {
+
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+
+    double time;
+    int read = fscanf(file, "%*s %lf", &time);
+    fclose(file);
+
+    // A worker that stopped right after creating the lease leaves
+    // it empty, the time it was modified is used instead
+    if (read != 1) {
+        QDateTime modified = QFileInfo(QString::fromStdString(path)).lastModified();
+        if (!modified.isValid()) {
+            return false;
+        }
+        time = modified.toMSecsSinceEpoch() / 1000.0;
+    }
+
+    return now() - time > leaseTimeout;
+}
@@ -0,0 +1,225 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The BatchRunner class runs blend jobs listed in a work
+ * directory with any number of worker processes, on one machine
+ * or on many machines sharing the directory.
+ *
+ * The work directory holds:
+ *     manifest.txt        one job per line, tab separated:
+ *                         image 1, image 2, output, and
+ *                         optionally the gradient start and
+ *                         end in percent (default 40 and 60)
+ *     leases/<job>.<n>    attempt n at a job, "worker time"
+ *     done/<job>          the result of a job
+ *
+ * A worker claims a job by creating the next lease file of the
+ * job, which only one worker can do. While working it writes the
+ * time into the lease every few seconds. A lease whose time is
+ * older than the timeout belongs to a worker that stopped, so
+ * the job can be claimed again with the next attempt. The clocks
+ * of the machines must agree to well within the timeout.
+ *
+ * A job that fails in a way that may pass, such as an image on
+ * shared storage that could not be read, has its lease released
+ * without a result and is retried, up to maxAttempts attempts. A
+ * job that would fail again is marked failed at once. The lease
+ * is kept until the result is written.
+ *
+ * Nothing but the files is shared, so workers started by
+ * runLocal behave the same as workers started on other
+ * machines.
+ */
+class BatchRunner
+{
+public:
+    /**
+     * @brief The Job struct is one line of the manifest
+     */
+    struct Job {
+        std::string src1;
+        std::string src2;
+        std::string output;
+        float startPercent;
+        float endPercent;
+    };
+
+    /**
+     * @brief The Progress struct is the state of all jobs, read
+     * from the work directory
+     */
+    struct Progress {
+        int jobs;
+        int done;
+        int failed;             // done, but without an output
+        int leased;             // being worked on
+        double seconds;         // from the first start to the last end
+        double megapixels;      // of the outputs
+        std::map<std::string, int> jobsPerWorker;
+
+        double jobsPerSecond() const {return seconds > 0 ? done / seconds : 0;}
+        double megapixelsPerSecond() const
+        {return seconds > 0 ? megapixels / seconds : 0;}
+    };
+
+    /**
+     * @brief BatchRunner creates a runner for a work directory
+     * @param dir the work directory
+     */
+    explicit BatchRunner(const std::string &dir);
+
+    /**
+     * @brief setLeaseTimeout sets how long a lease is kept
+     * without being renewed. All workers should use the same.
+     * @param seconds the timeout in seconds, more than 3
+     */
+    void setLeaseTimeout(int seconds) {leaseTimeout = max(seconds, 3);}
+    /**
+     * @brief setLayers sets the number of layers of the pyramids
+     * @param layers the number of layers, 0 for the maximum
+     */
+    void setLayers(int layers) {this->layers = layers;}
+
+    /**
+     * @brief runWorker claims and runs jobs until every job is
+     * done
+     * @param worker the name of the worker, different for every
+     * worker on every machine
+     * @return 0 if no error, 1 if the manifest could not be
+     * read, 2 if the directories could not be created
+     */
+    int runWorker(const std::string &worker);
+    /**
+     * @brief getProgress reads the state of all jobs
+     * @return the progress, jobs is -1 if the manifest could not
+     * be read
+     */
+    Progress getProgress() const;
+
+    /**
+     * @brief pinToCores makes the process, and the threads it
+     * starts later, run on some cores only, and sets the number
+     * of OpenCV threads to the number of cores. If the cores are
+     * on one NUMA node, memory is allocated on that node while
+     * it has free memory. Otherwise the memory of each page is
+     * on the node of the thread that first writes to it.
+     * @param cores the indices of the cores
+     * @return 0 if no error, 1 if the cores could not be set
+     */
+    static int pinToCores(const std::vector<int> &cores);
+    /**
+     * @brief numaNodes gets the cores of each NUMA node of the
+     * machine, such as each socket
+     * @return the cores of each node with cores. One node with
+     * all cores if the nodes are not known.
+     */
+    static std::vector< std::vector<int> > numaNodes();
+    /**
+     * @brief parseCores parses a list of cores
+     * @param list the list, such as "0-3,8,9"
+     * @return the indices of the cores
+     */
+    static std::vector<int> parseCores(const std::string &list);
+
+private:
+    std::string dir;
+    int leaseTimeout;
+    int layers;
+
+    std::vector<Job> jobs;
+
+    // attempts at a job before a failure that may pass is kept,
+    // and the seconds before the next attempt
+    static const int maxAttempts = 3;
+    static const int retryDelay = 5;
+
+    // the lease renewed by the heartbeat, empty if none
+    std::string currentLease;
+    std::string currentWorker;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    /**
+     * @brief readManifest reads the jobs from the manifest
+     * @param dir the work directory
+     * @param jobs set to the jobs
+     * @return 0 if no error, 1 if it could not be read
+     */
+    static int readManifest(const std::string &dir, std::vector<Job> &jobs);
+    /**
+     * @brief writeDone writes the result of a job
+     * @param job the index of the job
+     * @param worker the name of the worker
+     * @param start the time the job started
+     * @param end the time the job ended
+     * @param megapixels the megapixels of the output, 0 if the
+     * job failed
+     * @return 0 if no error, 1 if it could not be written
+     */
+    int writeDone(int job, const std::string &worker,
+                  double start, double end, double megapixels) const;
+    /**
+     * @brief claim tries to take a job
+     * @param job the index of the job
+     * @param worker the name of the worker
+     * @param lease set to the path of the lease if claimed
+     * @param attempt set to the number of the attempt, from 0
+     * @return true if claimed
+     */
+    bool claim(int job, const std::string &worker,
+               std::string &lease, int &attempt);
+    /**
+     * @brief heartbeat renews the current lease until stopped
+     */
+    void heartbeat();
+    /**
+     * @brief runJob blends the images of a job and writes the
+     * output, reusing the pyramids between jobs
+     * @param job the job
+     * @param pyr1 pyramid for the first image
+     * @param pyr2 pyramid for the second image
+     * @param blended pyramid for the result
+     * @param megapixels set to the megapixels of the output
+     * @return 0 if no error, 1 if the job failed and would fail
+     * again, 2 if it failed in a way that may pass when retried
+     */
+    int runJob(const Job &job, ImagePyramid &pyr1,
+               ImagePyramid &pyr2, ImagePyramid &blended,
+               double &megapixels);
+
+    /* Files */
+    std::string leasePath(int job, int attempt) const;
+    std::string donePath(int job) const;
+    bool isDone(int job) const;
+    /**
+     * @brief latestAttempt finds the last lease of a job
+     * @param job the index of the job
+     * @return the number of leases created for the job
+     */
+    int latestAttempt(int job) const;
+    /**
+     * @brief leaseExpired checks if a lease was not renewed
+     * within the timeout. A lease without a time, because its
+     * worker stopped before writing it, expires the timeout
+     * after the file was last modified.
+     * @param path the path of the lease
+     * @return true if expired
+     */
+    bool leaseExpired(const std::string &path) const;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,313 @@
+#include "blendmask.h"
+
+#include <cmath>
+#include <cstring>
+
+BlendMask::BlendMask(const Mat &mask) :
+    kind(DENSE), size(mask.size()), levels(0),
+    innerRadius(0), outerRadius(0)
+{
+    if (!mask.empty()) {
+        assert(mask.type() == CV_32FC1);
+        denseLevels.push_back(mask);
+        levels = 1;
+    }
+}
+
+BlendMask BlendMask::separable(const Mat &colProfile, int rows) {
+
+    assert(colProfile.type() == CV_32FC1 && colProfile.rows == 1);
+
+    BlendMask mask;
+    mask.kind = SEPARABLE;
+    mask.size = Size(colProfile.cols, rows);
+    mask.colProfiles.push_back(colProfile);
+    mask.rowProfiles.push_back(Mat());  // every row has weight 1
+    mask.levels = 1;
+
+    return mask;
+}
+
+BlendMask BlendMask::separable(const Mat &colProfile, const Mat &rowProfile) {
+
+    assert(rowProfile.type() == CV_32FC1 && rowProfile.rows == 1);
+
+    BlendMask mask = separable(colProfile, rowProfile.cols);
+    mask.rowProfiles[0] = rowProfile;
+
+    return mask;
+}
+
+BlendMask BlendMask::linearGradient(
+        const Size &size, Point2f start, Point2f end) {
+
+    BlendMask mask;
+    mask.kind = LINEAR;
+    mask.size = size;
+    mask.origin = start;
+    mask.direction = end - start;
+    mask.levels = 1;
+
+    return mask;
+}
+
+BlendMask BlendMask::radialGradient(
+        const Size &size, Point2f center,
+        float innerRadius, float outerRadius) {
+
+    BlendMask mask;
+    mask.kind = RADIAL;
+    mask.size = size;
+    mask.origin = center;
+    mask.innerRadius = innerRadius;
+    mask.outerRadius = outerRadius;
+    mask.levels = 1;
+
+    return mask;
+}
+
+Size BlendMask::getSize(int level) const {
+
+    Size levelSize = size;
+
+    // same sizes as pyrDown
+    for (int i = 0; i < level; i++) {
+        levelSize = Size((levelSize.width + 1) / 2, (levelSize.height + 1) / 2);
+    }
+
+    return levelSize;
+}
+
+void BlendMask::setLevels(int levels) {
+
+    if (levels <= this->levels || empty()) {
+        return;
+    }
+
+    if (kind == DENSE) {
+        while ((int) denseLevels.size() < levels) {
+            Mat next;
+            pyrDown(denseLevels.back(), next);
+            denseLevels.push_back(next);
+        }
+    }
+    else if (kind == SEPARABLE) {
+        // pyrDown of the product is the product of the
+        // downsampled profiles, since the kernel is separable
+        while ((int) colProfiles.size() < levels) {
+            colProfiles.push_back(pyrDownProfile(colProfiles.back()));
+
+            const Mat &rowProfile = rowProfiles.back();
+            rowProfiles.push_back(
+                        rowProfile.empty() ? Mat() : pyrDownProfile(rowProfile));
+        }
+    }
+    // analytic masks are evaluated directly at each level
+
+    this->levels = levels;
+}
+
+const float *BlendMask::getRow(
+        int level, int row, int colStart, int cols,
+        float *buf) const {
+
+    assert(level >= 0 && level < levels);
+
+    if (kind == DENSE) {
+        return denseLevels[level].ptr<float>(row) + colStart;
+    }
+    else if (kind == SEPARABLE) {
+        const float *colProfile = colProfiles[level].ptr<float>() + colStart;
+
+        const Mat &rowProfile = rowProfiles[level];
+        float rowWeight = rowProfile.empty() ? 1.0f : rowProfile.at<float>(0, row);
+
+        // the common case, the row is the profile itself
+        if (rowWeight == 1.0f) {
+            return colProfile;
+        }
+
+        for (int col = 0; col < cols; col++) {
+            buf[col] = colProfile[col] * rowWeight;
+        }
+        return buf;
+    }
+    else {
+        float scale = (float) (1 << level);
+        for (int col = 0; col < cols; col++) {
+            buf[col] = analyticValue(colStart + col, row, scale);
+        }
+        return buf;
+    }
+}
+
+void BlendMask::getRange(int level, const Rect &rect, float &lo, float &hi) const {
+
+    assert(level >= 0 && level < levels);
+    assert(rect.area() > 0);
+
+    if (kind == DENSE) {
+        double minVal, maxVal;
+        minMaxLoc(denseLevels[level](rect), &minVal, &maxVal);
+        lo = (float) minVal;
+        hi = (float) maxVal;
+    }
+    else if (kind == SEPARABLE) {
+        double colMin, colMax;
+        minMaxLoc(colProfiles[level].colRange(rect.x, rect.x + rect.width),
+                  &colMin, &colMax);
+
+        double rowMin = 1.0, rowMax = 1.0;
+        const Mat &rowProfile = rowProfiles[level];
+        if (!rowProfile.empty()) {
+            minMaxLoc(rowProfile.colRange(rect.y, rect.y + rect.height),
+                      &rowMin, &rowMax);
+        }
+
+        // weights are not negative
+        lo = (float) (colMin * rowMin);
+        hi = (float) (colMax * rowMax);
+    }
+    else {
+        float scale = (float) (1 << level);
+        int x0 = rect.x, x1 = rect.x + rect.width - 1;
+        int y0 = rect.y, y1 = rect.y + rect.height - 1;
+
+        float corners[4] = {
+            analyticValue(x0, y0, scale), analyticValue(x1, y0, scale),
+            analyticValue(x0, y1, scale), analyticValue(x1, y1, scale)
+        };
+
+        // a clamped linear gradient is monotonic, so the corners
+        // are the extremes
+        lo = min(min(corners[0], corners[1]), min(corners[2], corners[3]));
+        hi = max(max(corners[0], corners[1]), max(corners[2], corners[3]));
+
+        if (kind == RADIAL) {
+            // the largest value is at the point nearest the center
+            float cx = min(max(origin.x / scale, (float) x0), (float) x1);
+            float cy = min(max(origin.y / scale, (float) y0), (float) y1);
+            hi = analyticValue(cx, cy, scale);
+        }
+    }
+}
+
+Mat BlendMask::toMat(int level) const {
+
+    if (kind == DENSE) {
+        return denseLevels[level].clone();
+    }
+
+    Size levelSize = getSize(level);
+    Mat mat(levelSize, CV_32FC1);
+
+    for (int row = 0; row < levelSize.height; row++) {
+        float *dst = mat.ptr<float>(row);
+        const float *values = getRow(level, row, 0, levelSize.width, dst);
+        if (values != dst) {
+            memcpy(dst, values, levelSize.width * sizeof(float));
+        }
+    }
+
+    return mat;
+}
+
+/*
+ * The mean of max(u + sigma * z, 0) for a standard normal z,
+ * the integral of a ramp smoothed by a Gaussian
+ */
+static double smoothRampIntegral(double u, double sigma) {
+    double z = u / sigma;
+    double cdf = 0.5 * std::erfc(-z / std::sqrt(2.0));
+    double pdf = std::exp(-0.5 * z * z) / std::sqrt(2.0 * CV_PI);
+    return u * cdf + sigma * pdf;
+}
+
+/*
+ * A ramp from 1 at t = 0 to 0 at t = length, clamped to 0 and 1
+ * and smoothed by a Gaussian. A length of 0 is a step at 0.
+ */
+static float smoothRamp(double t, double length, double sigma) {
+
+    double value;
+
+    if (sigma <= 0) {
+        value = length > 0 ? 1 - t / length : (t < 0 ? 1 : 0);
+    }
+    else if (length <= 0) {
+        // the step of the pixels is half way between the last
+        // pixel before 0 and the pixel at 0
+        value = 0.5 * std::erfc((t + 0.5) / (sigma * std::sqrt(2.0)));
+    }
+    else {
+        value = 1 - (smoothRampIntegral(t, sigma) -
+                     smoothRampIntegral(t - length, sigma)) / length;
+    }
+
+    return (float) min(max(value, 0.0), 1.0);
+}
+
+float BlendMask::analyticValue(float x, float y, float scale) const {
+
+    // position in full size pixels
+    float px = x * scale - origin.x;
+    float py = y * scale - origin.y;
+
+    // Each pyrDown adds the variance of its kernel, 1 pixel of
+    // the level it reads, so a level is the mask smoothed by a
+    // Gaussian of variance (scale^2 - 1) / 3 full size pixels.
+    // Across the gradient that is the 1-D ramp smoothed the
+    // same way. For radial masks this holds where the radius is
+    // large against the smoothing.
+    double sigma = std::sqrt(max(scale * scale - 1.0f, 0.0f) / 3);
+
+    if (kind == LINEAR) {
+        double length = std::sqrt(direction.dot(direction));
+        if (length == 0) {
+            // start and end are the same, step at start
+            return smoothRamp(px, 0, sigma);
+        }
+        double t = (px * direction.x + py * direction.y) / length;
+        return smoothRamp(t, length, sigma);
+    }
+    else {
+        double distance = std::sqrt(px * px + py * py);
+        return smoothRamp(distance - innerRadius,
+                          max(outerRadius - innerRadius, 0.0f), sigma);
+    }
+}
+
+/*
+ * Border index like BORDER_REFLECT_101, the default border
+ * of pyrDown
+ */
+static int reflect101(int i, int n) {
+    if (n == 1) {
+        return 0;
+    }
+    while (i < 0 || i >= n) {
+        i = i < 0 ? -i : 2 * n - 2 - i;
+    }
+    return i;
+}
+
+Mat BlendMask::pyrDownProfile(const Mat &src) {
+
+    assert(src.type() == CV_32FC1 && src.rows == 1);
+
+    int n = src.cols;
+    Mat dst(1, (n + 1) / 2, CV_32FC1);
+
+    const float *s = src.ptr<float>();
+    float *d = dst.ptr<float>();
+
+    // 5-tap binomial kernel (1 4 6 4 1) / 16
+    for (int i = 0; i < dst.cols; i++) {
+        int c = 2 * i;
+        d[i] = (s[reflect101(c - 2, n)] + s[reflect101(c + 2, n)]
+                + 4 * (s[reflect101(c - 1, n)] + s[reflect101(c + 1, n)])
+                + 6 * s[c]) * (1.0f / 16);
+    }
+
+    return dst;
+}
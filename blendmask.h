@@ -0,0 +1,194 @@
+#ifndef BLENDMASK_H
+#define BLENDMASK_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <vector>
+
+using namespace cv;
+
+/**
+ * @brief The BlendMask class is the mask used to blend two
+ * image pyramids. The mask is 1 where only the first source
+ * is used and 0 where only the second source is used.
+ *
+ * The mask can be stored as a dense CV_32FC1 image, as a
+ * column profile times a row profile (separable), or as a
+ * linear or radial gradient (analytic). The separable and
+ * analytic kinds compute each pyramid level directly at its
+ * resolution, so the full size mask is never allocated.
+ */
+class BlendMask
+{
+public:
+    /**
+     * @brief The Kind enum is how the mask is represented
+     */
+    enum Kind {
+        DENSE,      // a CV_32FC1 image per level
+        SEPARABLE,  // column profile times row profile
+        LINEAR,     // linear gradient between two points
+        RADIAL      // radial gradient around a point
+    };
+
+    /* Constructors */
+    /**
+     * @brief BlendMask default constructor for default
+     * constructor purposes. The mask is empty.
+     */
+    BlendMask() :
+        kind(DENSE), levels(0), innerRadius(0), outerRadius(0) {}
+    /**
+     * @brief BlendMask creates a dense mask
+     * @param mask the mask. Must be CV_32FC1. The data is
+     * shared, not copied.
+     */
+    BlendMask(const Mat &mask);
+
+    /**
+     * @brief separable creates a mask where every row is the
+     * same 1-D profile
+     * @param colProfile the value of each column. Must be a
+     * single CV_32FC1 row.
+     * @param rows the number of rows of the mask
+     * @return the mask
+     */
+    static BlendMask separable(const Mat &colProfile, int rows);
+    /**
+     * @brief separable creates a mask that is the product of a
+     * column profile and a row profile
+     * @param colProfile the weight of each column. Must be a
+     * single CV_32FC1 row.
+     * @param rowProfile the weight of each row. Must be a
+     * single CV_32FC1 row.
+     * @return the mask
+     */
+    static BlendMask separable(const Mat &colProfile, const Mat &rowProfile);
+    /**
+     * @brief linearGradient creates a mask that goes linearly
+     * from 1 at start to 0 at end. Points before start are 1,
+     * points after end are 0.
+     * @param size size of the mask
+     * @param start where the gradient starts, in pixels
+     * @param end where the gradient ends, in pixels
+     * @return the mask
+     */
+    static BlendMask linearGradient(
+            const Size &size, Point2f start, Point2f end);
+    /**
+     * @brief radialGradient creates a mask that is 1 inside the
+     * inner radius and goes linearly to 0 at the outer radius
+     * @param size size of the mask
+     * @param center center of the gradient, in pixels
+     * @param innerRadius radius where the gradient starts
+     * @param outerRadius radius where the gradient ends
+     * @return the mask
+     */
+    static BlendMask radialGradient(
+            const Size &size, Point2f center,
+            float innerRadius, float outerRadius);
+
+    /* Getters */
+    /**
+     * @brief getKind gets how the mask is represented
+     * @return the kind of mask
+     */
+    Kind getKind() const {return kind;}
+    /**
+     * @brief empty checks if the mask has no pixels
+     * @return true if empty
+     */
+    bool empty() const {return size.area() == 0;}
+    /**
+     * @brief getSize gets the size of a level of the mask
+     * @param level the level, 0 is the full size
+     * @return the size of the level
+     */
+    Size getSize(int level = 0) const;
+    /**
+     * @brief getLevels gets the number of levels prepared
+     * @return the number of levels
+     */
+    int getLevels() const {return levels;}
+    /**
+     * @brief setLevels prepares the representation of the
+     * levels 0 to levels-1. Does nothing if enough levels
+     * are already prepared.
+     * @param levels the number of levels to prepare
+     */
+    void setLevels(int levels);
+
+    /**
+     * @brief getRow gets the values of part of a row of a level
+     * @param level the level. Must be prepared.
+     * @param row the row
+     * @param colStart the first column
+     * @param cols the number of columns
+     * @param buf a buffer of at least cols floats the values can
+     * be written to if they are not stored
+     * @return a pointer to the values, either into the mask or
+     * to buf
+     */
+    const float *getRow(
+            int level, int row, int colStart, int cols,
+            float *buf) const;
+    /**
+     * @brief getRange gets the smallest and largest value of a
+     * rectangle of a level
+     * @param level the level. Must be prepared.
+     * @param rect the rectangle in the coordinates of the level
+     * @param lo output smallest value
+     * @param hi output largest value
+     */
+    void getRange(int level, const Rect &rect, float &lo, float &hi) const;
+
+    /**
+     * @brief toMat creates a dense image of a level
+     * @param level the level. Must be prepared.
+     * @return the level as a CV_32FC1 image
+     */
+    Mat toMat(int level = 0) const;
+
+private:
+    Kind kind;
+    Size size;
+    int levels;
+
+    // DENSE: one image per level
+    std::vector<Mat> denseLevels;
+
+    // SEPARABLE: one profile per level. An empty row profile
+    // means every row has weight 1.
+    std::vector<Mat> colProfiles;
+    std::vector<Mat> rowProfiles;
+
+    // LINEAR and RADIAL, in full size pixels
+    Point2f origin;
+    Point2f direction;  // LINEAR: end - start
+    float innerRadius;
+    float outerRadius;
+
+    /**
+     * @brief analyticValue computes the value of a LINEAR or
+     * RADIAL mask at a point of a level. Levels above 0 are the
+     * gradient smoothed the way pyrDown smooths it, like the
+     * levels of the same mask stored as an image.
+     * @param x column of the level
+     * @param y row of the level
+     * @param scale size of a pixel of the level in full size
+     * pixels
+     * @return the value of the mask
+     */
+    float analyticValue(float x, float y, float scale) const;
+
+    /**
+     * @brief pyrDownProfile downsamples a 1-D profile the same
+     * way pyrDown downsamples each row or column of an image
+     * @param src the profile
+     * @return the downsampled profile
+     */
+    static Mat pyrDownProfile(const Mat &src);
+};
+
+#endif // BLENDMASK_H
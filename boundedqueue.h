@@ -0,0 +1,58 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief The BoundedQueue class is a thread safe FIFO queue
+ * with a maximum size, used to pass work between the stages
+ * of a pipeline. push() waits while the queue is full and
+ * pop() waits while it is empty.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    /**
+     * @brief BoundedQueue creates an empty queue
+     * @param capacity the maximum number of items
+     */
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    /**
+     * @brief push adds an item, waiting until there is room
+     * @param item the item to add
+     */
+    void push(const T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] {return items.size() < capacity;});
+        items.push_back(item);
+        notEmpty.notify_one();
+    }
+
+    /**
+     * @brief pop removes the oldest item, waiting until there
+     * is one
+     * @return the item
+     */
+    T pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] {return !items.empty();});
+        T item = items.front();
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,835 @@
+#include "commandline.h"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QList>
+#include <QProcess>
+#include <QStringList>
+#include <QSysInfo>
+
+#include <iostream>
+
+#include "autotuner.h"
+#include "backgroundblender.h"
+#include "batchrunner.h"
+#include "compressedpyramid.h"
+#include "deepzoomexporter.h"
+#include "seamfinder.h"
+#include "sequenceblender.h"
+
+bool isCommandLine(int argc, char *argv[]) {
+    return argc > 1 && QString(argv[1]).startsWith("--");
+}
+
+/*
+ * Blends two videos or image sequences frame by frame and
+ * reports the throughput
+ */
+static int runSequence(const QCommandLineParser &parser,
+                       const QCommandLineOption &layersOption,
+                       const QCommandLineOption &keyframeOption) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.size() != 3) {
+        std::cerr << "--sequence needs <source 1> <source 2> <output>" << std::endl;
+        return 1;
+    }
+
+    SequenceBlender blender;
+
+    switch (blender.open(paths[0].toStdString(), paths[1].toStdString())) {
+    case 0:     // no error
+        break;
+    case 1:     // first source
+        std::cerr << "Could not open " << paths[0].toStdString() << std::endl;
+        return 1;
+    default:    // second source
+        std::cerr << "Could not open " << paths[1].toStdString() << std::endl;
+        return 1;
+    }
+
+    blender.setOutput(paths[2].toStdString());
+
+    if (blender.setLayers(parser.value(layersOption).toInt()) != 0) {
+        std::cerr << "The number of layers can not be negative" << std::endl;
+        return 1;
+    }
+
+    // frame:start:end
+    foreach (const QString &keyframe, parser.values(keyframeOption)) {
+        QStringList parts = keyframe.split(':');
+        if (parts.size() != 3) {
+            std::cerr << "Invalid keyframe " << keyframe.toStdString() << std::endl;
+            return 1;
+        }
+        blender.addKeyframe(parts[0].toInt(), parts[1].toFloat(), parts[2].toFloat());
+    }
+
+    int error = blender.run();
+    if (error != 0) {
+        std::cerr << "Blending failed with error " << error << std::endl;
+        return error;
+    }
+
+    std::cout << blender.getFrames() << " frames in "
+              << blender.getSeconds() << " s, "
+              << blender.getFramesPerSecond() << " frames per second" << std::endl;
+    std::cout << "Busy time: decode " << blender.getStageSeconds(SequenceBlender::DECODE)
+              << " s, build " << blender.getStageSeconds(SequenceBlender::BUILD)
+              << " s, blend " << blender.getStageSeconds(SequenceBlender::BLEND)
+              << " s, encode " << blender.getStageSeconds(SequenceBlender::ENCODE)
+              << " s" << std::endl;
+
+    return 0;
+}
+
+/*
+ * Blends two images and writes the result, and optionally a
+ * Deep Zoom tile tree made from the reconstruction layers
+ */
+static int runBlend(const QCommandLineParser &parser,
+                    const QCommandLineOption &layersOption,
+                    const QCommandLineOption &startOption,
+                    const QCommandLineOption &endOption,
+                    const QCommandLineOption &seamOption,
+                    const QCommandLineOption &dziOption,
+                    const QCommandLineOption &leanOption) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.size() != 3) {
+        std::cerr << "--blend needs <image 1> <image 2> <output>" << std::endl;
+        return 1;
+    }
+
+    Mat image1 = imread(paths[0].toStdString(), IMREAD_COLOR);
+    Mat image2 = imread(paths[1].toStdString(), IMREAD_COLOR);
+    if (image1.empty() || image2.empty()) {
+        std::cerr << "Could not read "
+                  << (image1.empty() ? paths[0] : paths[1]).toStdString() << std::endl;
+        return 1;
+    }
+
+    // the second image uses the size of the first
+    ImagePyramid pyr1(image1);
+    ImagePyramid pyr2(image2, pyr1.getSize());
+
+    int layers = parser.value(layersOption).toInt();
+    if (layers > 0) {
+        pyr1.setLayers(layers);
+        pyr2.setLayers(layers);
+    }
+
+    // the sources are only needed as layers from here on
+    bool lean = parser.isSet(leanOption);
+    pyr1.setLean(lean);
+    pyr2.setLean(lean);
+
+    Size size = pyr1.getSize();
+    float start = parser.value(startOption).toFloat();
+    float end = parser.value(endOption).toFloat();
+
+    BlendMask mask;
+    if (parser.isSet(seamOption)) {
+        SeamFinder seamFinder;
+        mask = seamFinder.findMask(
+                    pyr1, pyr2,
+                    (int) (size.width * start / 100), (int) (size.width * end / 100));
+    }
+    else {
+        mask = BlendMask::linearGradient(
+                    size,
+                    Point2f(size.width * start / 100, 0),
+                    Point2f(size.width * end / 100, 0));
+    }
+
+    ImagePyramid blended;
+    blended.setLean(lean);
+
+    if (parser.isSet(dziOption)) {
+        DeepZoomExporter exporter(parser.value(dziOption).toStdString());
+        if (exporter.begin(size) != 0) {
+            std::cerr << "Could not create the tile directories" << std::endl;
+            return 1;
+        }
+
+        // tiles are written while the blend is reconstructed
+        blended.blendFused(pyr1, pyr2, mask, exporter.callback());
+
+        switch (exporter.finish()) {
+        case 0:     // no error
+            break;
+        case 3:     // tiles
+            std::cerr << "Could not write " << exporter.getFailedTiles()
+                      << " tiles" << std::endl;
+            return 1;
+        default:    // .dzi file
+            std::cerr << "Could not write the .dzi file" << std::endl;
+            return 1;
+        }
+        std::cout << exporter.getTiles() << " tiles in "
+                  << exporter.getSeconds() << " s" << std::endl;
+    }
+    else {
+        blended.blendFused(pyr1, pyr2, mask);
+    }
+
+    if (!imwrite(paths[2].toStdString(), blended.getImage())) {
+        std::cerr << "Could not write " << paths[2].toStdString() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Memory: " << MemoryBudget::getPeak() / (1 << 20) << " MB peak" << std::endl;
+
+    return 0;
+}
+
+/*
+ * Blends one background with many foregrounds using the same
+ * mask, building the background and mask pyramids once
+ */
+static int runBlendMany(const QCommandLineParser &parser,
+                        const QCommandLineOption &layersOption,
+                        const QCommandLineOption &startOption,
+                        const QCommandLineOption &endOption,
+                        const QCommandLineOption &maskOption,
+                        const QCommandLineOption &workersOption) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.size() < 3) {
+        std::cerr << "--blend-many needs <background> <output directory> <foreground>..."
+                  << std::endl;
+        return 1;
+    }
+
+    // one worker per CPU unless set
+    BackgroundBlender blender;
+    if (parser.isSet(workersOption)) {
+        blender.setWorkers(parser.value(workersOption).toInt());
+    }
+
+    switch (blender.setBackground(paths[0].toStdString(),
+                                  parser.value(layersOption).toInt())) {
+    case 0:     // no error
+        break;
+    case 1:     // could not read
+        std::cerr << "Could not read " << paths[0].toStdString() << std::endl;
+        return 1;
+    default:    // layers
+        std::cerr << "Too many layers for the size of the background" << std::endl;
+        return 1;
+    }
+
+    Size size = blender.getSize();
+
+    BlendMask mask;
+    if (parser.isSet(maskOption)) {
+        // white where the foreground is used
+        Mat maskImage = imread(parser.value(maskOption).toStdString(), IMREAD_GRAYSCALE);
+        if (maskImage.empty()) {
+            std::cerr << "Could not read " << parser.value(maskOption).toStdString()
+                      << std::endl;
+            return 1;
+        }
+        resize(maskImage, maskImage, size);
+
+        Mat values;
+        maskImage.convertTo(values, CV_32F, 1.0 / 255);
+        mask = BlendMask(values);
+    }
+    else {
+        float start = parser.value(startOption).toFloat();
+        float end = parser.value(endOption).toFloat();
+        mask = BlendMask::linearGradient(
+                    size,
+                    Point2f(size.width * start / 100, 0),
+                    Point2f(size.width * end / 100, 0));
+    }
+    blender.setMask(mask);
+
+    // the results keep the names of the foregrounds
+    QDir outputDir(paths[1]);
+    if (!outputDir.mkpath(".")) {
+        std::cerr << "Could not create " << paths[1].toStdString() << std::endl;
+        return 1;
+    }
+
+    std::vector<BackgroundBlender::Job> jobs;
+    for (int i = 2; i < paths.size(); i++) {
+        BackgroundBlender::Job job = {
+            paths[i].toStdString(),
+            outputDir.filePath(QFileInfo(paths[i]).fileName()).toStdString()
+        };
+        jobs.push_back(job);
+    }
+
+    int error = blender.run(jobs);
+
+    std::cout << blender.getJobs() << " jobs in "
+              << blender.getSeconds() << " s, "
+              << blender.getJobsPerSecond() << " jobs per second, "
+              << blender.getFailed() << " failed" << std::endl;
+    std::cout << "Once: background and mask "
+              << blender.getSharedSeconds() * 1000 << " ms" << std::endl;
+
+    int done = max(blender.getJobs(), 1);
+    std::cout << "Per job: decode "
+              << blender.getStageSeconds(BackgroundBlender::DECODE) * 1000 / done
+              << " ms, build "
+              << blender.getStageSeconds(BackgroundBlender::BUILD) * 1000 / done
+              << " ms, blend "
+              << blender.getStageSeconds(BackgroundBlender::BLEND) * 1000 / done
+              << " ms, encode "
+              << blender.getStageSeconds(BackgroundBlender::ENCODE) * 1000 / done
+              << " ms" << std::endl;
+    std::cout << "Saved: " << blender.getSavedFraction() * 100
+              << "% of the cost of the jobs" << std::endl;
+
+    return error == 0 ? 0 : 1;
+}
+
+/*
+ * Builds and blends the pyramids of two images with each filter
+ * and reports the time and the PSNR of the result against the
+ * 5x5 binomial filter
+ */
+static int runBenchFilters(const QCommandLineParser &parser) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.size() != 2) {
+        std::cerr << "--bench-filters needs <image 1> <image 2>" << std::endl;
+        return 1;
+    }
+
+    Mat image1 = imread(paths[0].toStdString(), IMREAD_COLOR);
+    Mat image2 = imread(paths[1].toStdString(), IMREAD_COLOR);
+    if (image1.empty() || image2.empty()) {
+        std::cerr << "Could not read "
+                  << (image1.empty() ? paths[0] : paths[1]).toStdString() << std::endl;
+        return 1;
+    }
+
+    // both pyramids get the same size
+    resize(image2, image2, image1.size());
+
+    static const int runs = 5;
+    const ImagePyramid::Filter filters[] = {
+        ImagePyramid::FILTER_BINOMIAL5,
+        ImagePyramid::FILTER_BINOMIAL3,
+        ImagePyramid::FILTER_BOX2
+    };
+    const char *names[] = {"binomial 5x5", "binomial 3x3", "box 2x2"};
+
+    Mat reference;
+
+    for (int i = 0; i < 3; i++) {
+        ImagePyramid pyr1, pyr2, blended;
+        pyr1.setFilter(filters[i]);
+        pyr2.setFilter(filters[i]);
+
+        BlendMask mask;
+        double buildSeconds = 0, blendSeconds = 0;
+
+        for (int run = 0; run < runs; run++) {
+            int64 start = getTickCount();
+            pyr1.setImage(image1);
+            pyr2.setImage(image2);
+            buildSeconds += (getTickCount() - start) / getTickFrequency();
+
+            if (mask.empty()) {
+                Size size = pyr1.getSize();
+                mask = BlendMask::linearGradient(
+                            size,
+                            Point2f(size.width * 0.4f, 0),
+                            Point2f(size.width * 0.6f, 0));
+            }
+
+            start = getTickCount();
+            blended.blend(pyr1, pyr2, mask);
+            blendSeconds += (getTickCount() - start) / getTickFrequency();
+        }
+
+        Mat result = blended.getImage();
+
+        std::cout << names[i] << ": build "
+                  << buildSeconds * 1000 / runs << " ms, blend "
+                  << blendSeconds * 1000 / runs << " ms, PSNR ";
+        if (reference.empty()) {
+            reference = result;
+            std::cout << "reference" << std::endl;
+        }
+        else {
+            std::cout << PSNR(reference, result) << " dB" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Compresses the pyramids of images and reports the compression
+ * ratio and the time to access the compressed layers
+ */
+static int runCompress(const QCommandLineParser &parser) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.isEmpty()) {
+        std::cerr << "--compress needs at least one image" << std::endl;
+        return 1;
+    }
+
+    std::vector<CompressedPyramid> pyramids;
+    size_t rawBytes = 0, compressedBytes = 0;
+
+    foreach (const QString &path, paths) {
+        Mat image = imread(path.toStdString(), IMREAD_COLOR);
+        if (image.empty()) {
+            std::cerr << "Could not read " << path.toStdString() << std::endl;
+            return 1;
+        }
+
+        CompressedPyramid pyramid((ImagePyramid(image)));
+        rawBytes += pyramid.getRawBytes();
+        compressedBytes += pyramid.getCompressedBytes();
+
+        std::cout << path.toStdString() << ": "
+                  << pyramid.getRawBytes() << " -> "
+                  << pyramid.getCompressedBytes() << " bytes, ratio "
+                  << pyramid.getCompressionRatio() << std::endl;
+
+        pyramids.push_back(pyramid);
+    }
+
+    std::cout << "Total: " << rawBytes << " -> " << compressedBytes
+              << " bytes, ratio " << (double) rawBytes / compressedBytes << std::endl;
+
+    // access every layer twice, the first access decompresses
+    CompressedPyramid::resetAccessStats();
+    int64 start = getTickCount();
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < pyramids.size(); i++) {
+            for (int layer = 0; layer < pyramids[i].getLayers(); layer++) {
+                pyramids[i].getLaplacian(layer);
+            }
+        }
+    }
+    double seconds = (getTickCount() - start) / getTickFrequency();
+
+    CompressedPyramid::AccessStats stats = CompressedPyramid::getAccessStats();
+    long long accesses = stats.hits + stats.misses;
+    std::cout << "Access: " << accesses << " layers, "
+              << stats.hits << " in working set, "
+              << stats.misses << " decompressed in "
+              << stats.decompressSeconds * 1000 << " ms ("
+              << (stats.misses > 0 ? stats.decompressSeconds * 1000 / stats.misses : 0)
+              << " ms per layer), "
+              << seconds * 1000 / accesses << " ms per access" << std::endl;
+
+    return 0;
+}
+
+/*
+ * Splits the cores of the machine between workers. The workers
+ * go to the NUMA nodes in turn and split the cores of their
+ * node, so each worker uses the memory of one node.
+ */
+static std::vector< std::vector<int> > splitCores(int workers) {
+
+    std::vector< std::vector<int> > nodes = BatchRunner::numaNodes();
+    std::vector< std::vector<int> > shares(workers);
+
+    int nodeCount = nodes.size();
+    for (int node = 0; node < nodeCount && node < workers; node++) {
+        const std::vector<int> &cores = nodes[node];
+        int count = (workers - node + nodeCount - 1) / nodeCount;
+
+        // consecutive cores of the node for each of its workers
+        for (int i = 0; i < count; i++) {
+            size_t first = cores.size() * i / count;
+            size_t last = cores.size() * (i + 1) / count;
+            shares[node + i * nodeCount].assign(cores.begin() + first, cores.begin() + last);
+        }
+    }
+
+    return shares;
+}
+
+static void printProgress(const BatchRunner::Progress &progress) {
+    std::cout << progress.done << "/" << progress.jobs << " jobs done, "
+              << progress.failed << " failed, "
+              << progress.leased << " running, "
+              << progress.jobsPerSecond() << " jobs/s, "
+              << progress.megapixelsPerSecond() << " MP/s" << std::endl;
+}
+
+/*
+ * Runs jobs from a work directory as one worker. Workers can run
+ * on any machine that shares the directory.
+ */
+static int runBatchWorker(const QCommandLineParser &parser,
+                          const QCommandLineOption &layersOption,
+                          const QCommandLineOption &leaseTimeoutOption) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.size() != 1) {
+        std::cerr << "--batch-worker needs <work directory>" << std::endl;
+        return 1;
+    }
+
+    BatchRunner runner(paths[0].toStdString());
+    runner.setLayers(parser.value(layersOption).toInt());
+    runner.setLeaseTimeout(parser.value(leaseTimeoutOption).toInt());
+
+    // unique across machines
+    QString worker = QSysInfo::machineHostName() + "-" +
+            QString::number(QCoreApplication::applicationPid());
+
+    switch (runner.runWorker(worker.toStdString())) {
+    case 0:     // no error
+        break;
+    case 1:     // manifest
+        std::cerr << "Could not read " << paths[0].toStdString() << "/manifest.txt" << std::endl;
+        return 1;
+    default:    // directories
+        std::cerr << "Could not create the directories in "
+                  << paths[0].toStdString() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Starts workers for a work directory on this machine, each
+ * pinned to its share of the cores of a NUMA node, and reports
+ * the progress until they are done
+ */
+static int runBatch(const QCommandLineParser &parser,
+                    const QCommandLineOption &layersOption,
+                    const QCommandLineOption &workersOption,
+                    const QCommandLineOption &leaseTimeoutOption,
+                    const QCommandLineOption &profileOption) {
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.size() != 1) {
+        std::cerr << "--batch needs <work directory>" << std::endl;
+        return 1;
+    }
+
+    int workers = parser.isSet(workersOption) ?
+                parser.value(workersOption).toInt() : (int) BatchRunner::numaNodes().size();
+    if (workers < 1) {
+        std::cerr << "There must be at least one worker" << std::endl;
+        return 1;
+    }
+
+    BatchRunner runner(paths[0].toStdString());
+    if (runner.getProgress().jobs < 0) {
+        std::cerr << "Could not read " << paths[0].toStdString() << "/manifest.txt" << std::endl;
+        return 1;
+    }
+
+    std::vector< std::vector<int> > cores = splitCores(workers);
+
+    QList<QProcess *> processes;
+    for (int i = 0; i < workers; i++) {
+        QStringList arguments;
+        arguments << "--batch-worker" << paths[0]
+                  << "--layers" << parser.value(layersOption)
+                  << "--lease-timeout" << parser.value(leaseTimeoutOption);
+        // the profile was loaded or made above, the workers load it
+        if (parser.isSet(profileOption)) {
+            arguments << "--profile" << parser.value(profileOption);
+        }
+        // more workers than cores of a node run on all cores
+        if (!cores[i].empty()) {
+            QStringList list;
+            for (size_t core = 0; core < cores[i].size(); core++) {
+                list << QString::number(cores[i][core]);
+            }
+            arguments << "--cores" << list.join(",");
+        }
+
+        QProcess *process = new QProcess();
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(QCoreApplication::applicationFilePath(), arguments);
+        if (!process->waitForStarted()) {
+            std::cerr << "Could not start worker " << i << std::endl;
+        }
+        processes << process;
+    }
+
+    // the progress is read from the directory, like for workers
+    // on other machines
+    int exitCode = 0;
+    foreach (QProcess *process, processes) {
+        while (!process->waitForFinished(1000) &&
+               process->state() != QProcess::NotRunning) {
+            printProgress(runner.getProgress());
+        }
+        if (process->exitCode() != 0) {
+            exitCode = 1;
+        }
+    }
+    qDeleteAll(processes);
+
+    BatchRunner::Progress progress = runner.getProgress();
+    printProgress(progress);
+    for (std::map<std::string, int>::const_iterator it = progress.jobsPerWorker.begin();
+         it != progress.jobsPerWorker.end(); it++) {
+        std::cout << "  " << it->first << ": " << it->second << " jobs" << std::endl;
+    }
+
+    return exitCode;
+}
+
+static void printTuning(const ImagePyramid::Tuning &tuning) {
+    std::cout << "Tuning: "
+              << (tuning.threads > 0 ? QString::number(tuning.threads) : QString("default"))
+                 .toStdString() << " threads, "
+              << tuning.maskTileSize << " pixel mask tiles, "
+              << tuning.stripeTiles << " tile rows per stripe, "
+              << (tuning.blendKernel == ImagePyramid::BLEND_KERNEL_EXPANDED ?
+                      "expanded" : "pixel") << " blend kernel" << std::endl;
+}
+
+/*
+ * Loads the tuning of this machine, or tunes and saves it with
+ * --retune, and applies the overrides of the command line.
+ * Without a profile, the default tuning is used.
+ */
+static void applyTuning(const QCommandLineParser &parser,
+                        const QCommandLineOption &profileOption,
+                        const QCommandLineOption &retuneOption,
+                        const QCommandLineOption &threadsOption,
+                        int pinnedCores) {
+
+    std::string path = parser.isSet(profileOption) ?
+                parser.value(profileOption).toStdString() :
+                Autotuner::defaultProfilePath();
+
+    switch (Autotuner::applyProfile(path, parser.isSet(retuneOption))) {
+    case 1:     // tuned and saved
+        std::cout << "Tuned for this machine, saved to " << path << std::endl;
+        printTuning(ImagePyramid::getTuning());
+        break;
+    case 2:     // tuned, not saved
+        std::cerr << "Could not save the tuning to " << path << std::endl;
+        printTuning(ImagePyramid::getTuning());
+        break;
+    default:    // loaded, or the default tuning
+        break;
+    }
+
+    // a process pinned to cores uses one thread per core
+    if (parser.isSet(threadsOption) || pinnedCores > 0) {
+        ImagePyramid::Tuning tuning = ImagePyramid::getTuning();
+        tuning.threads = parser.isSet(threadsOption) ?
+                    parser.value(threadsOption).toInt() : pinnedCores;
+        ImagePyramid::setTuning(tuning);
+    }
+}
+
+int runCommandLine(const QCoreApplication &app) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Merging 2 images using Laplacian Pyramids");
+    parser.addHelpOption();
+    parser.addPositionalArgument("paths", "Sources and output of the mode.");
+
+    /* Modes */
+    QCommandLineOption blendOption(
+                "blend",
+                "Blend two images. Paths: <image 1> <image 2> <output>.");
+    parser.addOption(blendOption);
+    QCommandLineOption blendManyOption(
+                "blend-many",
+                "Blend one background with many foregrounds using the same mask. "
+                "Paths: <background> <output directory> <foreground>...");
+    parser.addOption(blendManyOption);
+    QCommandLineOption sequenceOption(
+                "sequence",
+                "Blend two videos or numbered image sequences frame by frame. "
+                "Paths: <source 1> <source 2> <output>.");
+    parser.addOption(sequenceOption);
+    QCommandLineOption compressOption(
+                "compress",
+                "Compress the pyramids of images and report the compression "
+                "ratio and access time. Paths: <image>...");
+    parser.addOption(compressOption);
+    QCommandLineOption benchFiltersOption(
+                "bench-filters",
+                "Time building and blending with each pyramid filter and "
+                "report the PSNR against the 5x5 binomial filter. "
+                "Paths: <image 1> <image 2>.");
+    parser.addOption(benchFiltersOption);
+    QCommandLineOption batchOption(
+                "batch",
+                "Run the jobs of a work directory with local worker processes. "
+                "Paths: <work directory>.");
+    parser.addOption(batchOption);
+    QCommandLineOption batchWorkerOption(
+                "batch-worker",
+                "Run the jobs of a work directory as one worker, on any machine "
+                "sharing the directory. Paths: <work directory>.");
+    parser.addOption(batchWorkerOption);
+    QCommandLineOption batchStatusOption(
+                "batch-status",
+                "Report the progress of all workers of a work directory. "
+                "Paths: <work directory>.");
+    parser.addOption(batchStatusOption);
+
+    /* Settings */
+    QCommandLineOption layersOption(
+                "layers", "Number of pyramid layers, 0 for the most.", "n", "0");
+    parser.addOption(layersOption);
+    QCommandLineOption keyframeOption(
+                "keyframe",
+                "Mask gradient from start to end percent at a frame. "
+                "Can be repeated, frames in between are interpolated.",
+                "frame:start:end");
+    parser.addOption(keyframeOption);
+    QCommandLineOption startOption(
+                "start", "Start of the mask gradient in percent.", "percent", "40");
+    parser.addOption(startOption);
+    QCommandLineOption endOption(
+                "end", "End of the mask gradient in percent.", "percent", "60");
+    parser.addOption(endOption);
+    QCommandLineOption maskOption(
+                "mask",
+                "Mask image for --blend-many, white where the foreground is used. "
+                "Replaces the gradient.",
+                "image");
+    parser.addOption(maskOption);
+    QCommandLineOption seamOption(
+                "seam", "Find a seam between start and end instead of a gradient.");
+    parser.addOption(seamOption);
+    QCommandLineOption dziOption(
+                "dzi",
+                "Also write the result as a Deep Zoom tile tree, "
+                "<name>.dzi and <name>_files.",
+                "name");
+    parser.addOption(dziOption);
+    QCommandLineOption leanOption(
+                "lean", "Keep only the data later steps need in the pyramids.");
+    parser.addOption(leanOption);
+    QCommandLineOption memoryBudgetOption(
+                "memory-budget",
+                "Memory for images in MB, over it lower memory ways are used. "
+                "0 for no limit.",
+                "MB", "0");
+    parser.addOption(memoryBudgetOption);
+    QCommandLineOption workersOption(
+                "workers",
+                "Number of worker processes for --batch, one per NUMA node if not set, or "
+                "worker threads for --blend-many, one per CPU if not set.",
+                "n");
+    parser.addOption(workersOption);
+    QCommandLineOption coresOption(
+                "cores", "Cores the process runs on, such as 0-3,8. Used by --batch for its workers.", "list");
+    parser.addOption(coresOption);
+    QCommandLineOption leaseTimeoutOption(
+                "lease-timeout",
+                "Seconds without a heartbeat after which a job is taken "
+                "from a worker.",
+                "seconds", "60");
+    parser.addOption(leaseTimeoutOption);
+    QCommandLineOption profileOption(
+                "profile",
+                "Tuning profile to use instead of the one of the user. "
+                "It is made with --retune, without it the default tuning is used.",
+                "file");
+    parser.addOption(profileOption);
+    QCommandLineOption retuneOption(
+                "retune",
+                "Tune for this machine again and save the profile. "
+                "Can be used without a mode, not with --batch-worker, "
+                "--batch-status or --compress.");
+    parser.addOption(retuneOption);
+    QCommandLineOption threadsOption(
+                "threads", "Number of threads, instead of the tuned number.", "n");
+    parser.addOption(threadsOption);
+
+    parser.process(app);
+
+    MemoryBudget::setLimit((size_t) parser.value(memoryBudgetOption).toInt() << 20);
+
+    // nothing is set up, and nothing is tuned, without a mode
+    bool hasMode = parser.isSet(blendOption) || parser.isSet(blendManyOption) ||
+            parser.isSet(sequenceOption) || parser.isSet(compressOption) ||
+            parser.isSet(benchFiltersOption) || parser.isSet(batchOption) ||
+            parser.isSet(batchWorkerOption) || parser.isSet(batchStatusOption);
+    if (!hasMode && !parser.isSet(retuneOption)) {
+        parser.showHelp(1);
+    }
+
+    // Workers load the profile --batch made, so workers started
+    // together on a new machine do not all tune at once and slow
+    // each other down. Status checks build no pyramids and
+    // compression builds each once, so neither gains from it.
+    if (parser.isSet(retuneOption) &&
+            (parser.isSet(batchWorkerOption) || parser.isSet(batchStatusOption) ||
+             parser.isSet(compressOption))) {
+        std::cerr << "--retune can not be used with --batch-worker, "
+                     "--batch-status or --compress" << std::endl;
+        return 1;
+    }
+
+    // before OpenCV starts its threads, which tuning does, so
+    // they get the cores too
+    int pinnedCores = 0;
+    if (parser.isSet(coresOption)) {
+        std::vector<int> cores = BatchRunner::parseCores(parser.value(coresOption).toStdString());
+        if (BatchRunner::pinToCores(cores) == 0) {
+            pinnedCores = cores.size();
+        }
+        else {
+            std::cerr << "Could not pin to cores " << parser.value(coresOption).toStdString()
+                      << ", running on all cores" << std::endl;
+        }
+    }
+
+    applyTuning(parser, profileOption, retuneOption, threadsOption, pinnedCores);
+
+    if (parser.isSet(blendOption)) {
+        return runBlend(parser, layersOption, startOption, endOption,
+                        seamOption, dziOption, leanOption);
+    }
+    if (parser.isSet(blendManyOption)) {
+        return runBlendMany(parser, layersOption, startOption, endOption,
+                            maskOption, workersOption);
+    }
+    if (parser.isSet(sequenceOption)) {
+        return runSequence(parser, layersOption, keyframeOption);
+    }
+    if (parser.isSet(compressOption)) {
+        return runCompress(parser);
+    }
+    if (parser.isSet(benchFiltersOption)) {
+        return runBenchFilters(parser);
+    }
+    if (parser.isSet(batchOption)) {
+        return runBatch(parser, layersOption, workersOption, leaseTimeoutOption,
+                        profileOption);
+    }
+    if (parser.isSet(batchWorkerOption)) {
+        return runBatchWorker(parser, layersOption, leaseTimeoutOption);
+    }
+    if (parser.isSet(batchStatusOption)) {
+        if (parser.positionalArguments().size() != 1) {
+            std::cerr << "--batch-status needs <work directory>" << std::endl;
+            return 1;
+        }
+        BatchRunner::Progress progress =
+                BatchRunner(parser.positionalArguments()[0].toStdString()).getProgress();
+        if (progress.jobs < 0) {
+            std::cerr << "Could not read the manifest" << std::endl;
+            return 1;
+        }
+        printProgress(progress);
+        return 0;
+    }
+
+    // --retune without a mode
+    return 0;
+}
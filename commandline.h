@@ -0,0 +1,23 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QCoreApplication>
+
+/**
+ * @brief isCommandLine checks if the program was started with
+ * command line options, so it runs without the window
+ * @param argc argc of main
+ * @param argv argv of main
+ * @return true if the first argument is an option
+ */
+bool isCommandLine(int argc, char *argv[]);
+
+/**
+ * @brief runCommandLine runs the mode selected by the command
+ * line options
+ * @param app the application, its arguments are used
+ * @return the exit code
+ */
+int runCommandLine(const QCoreApplication &app);
+
+#endif // COMMANDLINE_H
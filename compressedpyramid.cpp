@@ -0,0 +1,318 @@
+#include "compressedpyramid.h"
+
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+
+/* Block coding */
+
+// values per block, each block is stored in the smallest mode
+static const int blockSize = 64;
+
+enum BlockMode {
+    BLOCK_ZERO = 0,     // all values are 0, nothing stored
+    BLOCK_2BIT = 1,     // values in [-2, 1], 4 per byte
+    BLOCK_4BIT = 2,     // values in [-8, 7], 2 per byte
+    BLOCK_RAW = 3       // one byte per value
+};
+
+/*
+ * Packs values into bits bits each, offset so they are not
+ * negative
+ */
+static void packBlock(const schar *src, int len, int bits, std::vector<uchar> &dst) {
+    int perByte = 8 / bits;
+    int offset = 1 << (bits - 1);
+    int valueMask = (1 << bits) - 1;
+
+    for (int i = 0; i < len; i += perByte) {
+        uchar packed = 0;
+        for (int k = 0; k < perByte && i + k < len; k++) {
+            packed |= ((src[i + k] + offset) & valueMask) << (bits * k);
+        }
+        dst.push_back(packed);
+    }
+}
+
+/*
+ * Reverses packBlock, returns the number of bytes read
+ */
+static size_t unpackBlock(const uchar *src, int len, int bits, schar *dst) {
+    int perByte = 8 / bits;
+    int offset = 1 << (bits - 1);
+    int valueMask = (1 << bits) - 1;
+
+    size_t read = 0;
+    for (int i = 0; i < len; i += perByte) {
+        uchar packed = src[read++];
+        for (int k = 0; k < perByte && i + k < len; k++) {
+            dst[i + k] = (schar) (((packed >> (bits * k)) & valueMask) - offset);
+        }
+    }
+    return read;
+}
+
+/* Working set */
+
+/*
+ * Decompressed levels of all compressed pyramids, the most
+ * recently used first
+ */
+struct WorkingSet {
+    struct Entry {
+        long long id;
+        int layer;
+        Mat level;
+    };
+    typedef std::pair<long long, int> Key;
+
+    std::mutex mutex;
+    std::list<Entry> entries;
+    std::map< Key, std::list<Entry>::iterator > index;
+    size_t bytes;
+    size_t limit;
+    CompressedPyramid::AccessStats stats;
+    MemoryBudget::Reservation reservation;
+
+    WorkingSet() : bytes(0), limit(64 << 20) {
+        stats.hits = stats.misses = 0;
+        stats.decompressSeconds = 0;
+    }
+
+    /*
+     * Removes the least recently used levels until the levels
+     * fit in the limit. The newest level is always kept.
+     * The bytes kept are counted in the MemoryBudget.
+     */
+    void evict() {
+        while (bytes > limit && entries.size() > 1) {
+            const Entry &oldest = entries.back();
+            bytes -= oldest.level.total() * oldest.level.elemSize();
+            index.erase(Key(oldest.id, oldest.layer));
+            entries.pop_back();
+        }
+        reservation.set(bytes);
+    }
+};
+
+static WorkingSet &workingSet() {
+    static WorkingSet set;
+    return set;
+}
+
+static std::atomic<long long> nextId(0);
+
+/* CompressedPyramid */
+
+CompressedPyramid::CompressedPyramid() :
+    levels(new std::vector<Level>()),
+    filter(ImagePyramid::FILTER_BINOMIAL5),
+    id(nextId++)
+{
+}
+
+CompressedPyramid::CompressedPyramid(const ImagePyramid &src) :
+    levels(new std::vector<Level>()),
+    filter(src.getFilter()),
+    id(nextId++)
+{
+    for (int layer = 0; layer < src.getLayers(); layer++) {
+        Mat laplacian = src.getLaplacian(layer);
+
+        // the last layer is Gaussian and is stored raw
+        levels->push_back(compressLevel(laplacian, laplacian.depth() == CV_8S));
+    }
+}
+
+Mat CompressedPyramid::getLaplacian(int layer) const {
+
+    if (layer < 0 || layer >= getLayers()) {
+        return Mat();   // empty matrix
+    }
+
+    WorkingSet &set = workingSet();
+    WorkingSet::Key key(id, layer);
+
+    {
+        std::lock_guard<std::mutex> lock(set.mutex);
+
+        std::map< WorkingSet::Key, std::list<WorkingSet::Entry>::iterator >::iterator
+                found = set.index.find(key);
+        if (found != set.index.end()) {
+            // move to the front as most recently used
+            set.entries.splice(set.entries.begin(), set.entries, found->second);
+            set.stats.hits++;
+            return found->second->level;
+        }
+        set.stats.misses++;
+    }
+
+    // decompress without holding the lock
+    int64 start = getTickCount();
+    Mat level = decompressLevel((*levels)[layer]);
+    double seconds = (getTickCount() - start) / getTickFrequency();
+
+    std::lock_guard<std::mutex> lock(set.mutex);
+    set.stats.decompressSeconds += seconds;
+
+    // another thread may have added it meanwhile
+    if (set.index.find(key) == set.index.end()) {
+        WorkingSet::Entry entry = {id, layer, level};
+        set.entries.push_front(entry);
+        set.index[key] = set.entries.begin();
+        set.bytes += level.total() * level.elemSize();
+        set.evict();
+    }
+
+    return level;
+}
+
+ImagePyramid CompressedPyramid::toPyramid() const {
+
+    // the pyramid owns its layers, so do not fill the working set
+    std::vector<Mat> laplacianPyr;
+    for (int layer = 0; layer < getLayers(); layer++) {
+        laplacianPyr.push_back(decompressLevel((*levels)[layer]));
+    }
+
+    return ImagePyramid(laplacianPyr, filter);
+}
+
+size_t CompressedPyramid::getRawBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < levels->size(); i++) {
+        const Level &level = (*levels)[i];
+        bytes += level.size.area() * CV_ELEM_SIZE(level.type);
+    }
+    return bytes;
+}
+
+size_t CompressedPyramid::getCompressedBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < levels->size(); i++) {
+        bytes += (*levels)[i].data.size();
+    }
+    return bytes;
+}
+
+double CompressedPyramid::getCompressionRatio() const {
+    size_t compressed = getCompressedBytes();
+    return compressed > 0 ? (double) getRawBytes() / compressed : 0;
+}
+
+void CompressedPyramid::setWorkingSetBytes(size_t bytes) {
+    WorkingSet &set = workingSet();
+    std::lock_guard<std::mutex> lock(set.mutex);
+    set.limit = bytes;
+    set.evict();
+}
+
+size_t CompressedPyramid::getWorkingSetBytes() {
+    WorkingSet &set = workingSet();
+    std::lock_guard<std::mutex> lock(set.mutex);
+    return set.limit;
+}
+
+CompressedPyramid::AccessStats CompressedPyramid::getAccessStats() {
+    WorkingSet &set = workingSet();
+    std::lock_guard<std::mutex> lock(set.mutex);
+    return set.stats;
+}
+
+void CompressedPyramid::resetAccessStats() {
+    WorkingSet &set = workingSet();
+    std::lock_guard<std::mutex> lock(set.mutex);
+    set.stats.hits = set.stats.misses = 0;
+    set.stats.decompressSeconds = 0;
+}
+
+CompressedPyramid::Level CompressedPyramid::compressLevel(const Mat &src, bool packed) {
+
+    Mat continuous = src.isContinuous() ? src : src.clone();
+    size_t n = continuous.total() * continuous.elemSize();
+
+    Level level;
+    level.size = src.size();
+    level.type = src.type();
+    level.packed = packed;
+
+    if (!packed) {
+        level.data.assign(continuous.data, continuous.data + n);
+        return level;
+    }
+
+    const schar *values = (const schar *) continuous.data;
+    level.data.reserve(n / 4);
+
+    for (size_t start = 0; start < n; start += blockSize) {
+        int len = (int) min((size_t) blockSize, n - start);
+        const schar *block = values + start;
+
+        int lo = 0, hi = 0;
+        for (int i = 0; i < len; i++) {
+            lo = min(lo, (int) block[i]);
+            hi = max(hi, (int) block[i]);
+        }
+
+        if (lo == 0 && hi == 0) {
+            level.data.push_back(BLOCK_ZERO);
+        }
+        else if (lo >= -2 && hi <= 1) {
+            level.data.push_back(BLOCK_2BIT);
+            packBlock(block, len, 2, level.data);
+        }
+        else if (lo >= -8 && hi <= 7) {
+            level.data.push_back(BLOCK_4BIT);
+            packBlock(block, len, 4, level.data);
+        }
+        else {
+            level.data.push_back(BLOCK_RAW);
+            level.data.insert(level.data.end(),
+                              (const uchar *) block, (const uchar *) block + len);
+        }
+    }
+
+    // compressed levels are kept for a long time
+    level.data.shrink_to_fit();
+
+    return level;
+}
+
+Mat CompressedPyramid::decompressLevel(const Level &level) {
+
+    Mat dst(level.size, level.type);
+    size_t n = dst.total() * dst.elemSize();
+
+    if (!level.packed) {
+        memcpy(dst.data, level.data.data(), n);
+        return dst;
+    }
+
+    schar *values = (schar *) dst.data;
+    const uchar *src = level.data.data();
+
+    for (size_t start = 0; start < n; start += blockSize) {
+        int len = (int) min((size_t) blockSize, n - start);
+        schar *block = values + start;
+
+        switch (*src++) {
+        case BLOCK_ZERO:
+            memset(block, 0, len);
+            break;
+        case BLOCK_2BIT:
+            src += unpackBlock(src, len, 2, block);
+            break;
+        case BLOCK_4BIT:
+            src += unpackBlock(src, len, 4, block);
+            break;
+        default:    // BLOCK_RAW
+            memcpy(block, src, len);
+            src += len;
+            break;
+        }
+    }
+
+    return dst;
+}
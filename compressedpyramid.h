@@ -0,0 +1,154 @@
+#ifndef COMPRESSEDPYRAMID_H
+#define COMPRESSEDPYRAMID_H
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The CompressedPyramid class stores the Laplacian
+ * pyramid of an ImagePyramid compressed, so many pyramids can
+ * be kept in memory.
+ *
+ * Laplacian values are mostly near zero, so each level is
+ * split into small blocks that are stored as nothing (all
+ * zero), 2 or 4 bits per value, or raw, whichever fits. Levels
+ * are decompressed on access into a working set shared by all
+ * compressed pyramids, which keeps the most recently used
+ * levels up to a size limit.
+ */
+class CompressedPyramid
+{
+public:
+    /**
+     * @brief The AccessStats struct counts accesses to the
+     * working set
+     */
+    struct AccessStats {
+        long long hits;         // level was in the working set
+        long long misses;       // level had to be decompressed
+        double decompressSeconds;
+    };
+
+    /* Constructors */
+    /**
+     * @brief CompressedPyramid default constructor, no layers
+     */
+    CompressedPyramid();
+    /**
+     * @brief CompressedPyramid compresses the Laplacian pyramid
+     * of an ImagePyramid. The images kept by the ImagePyramid
+     * are not stored, they are reconstructed when needed.
+     * @param src the pyramid to compress
+     */
+    explicit CompressedPyramid(const ImagePyramid &src);
+
+    /* Getters */
+    /**
+     * @brief getLayers gets the number of layers
+     * @return the number of layers
+     */
+    int getLayers() const {return levels->size();}
+    /**
+     * @brief getSize gets the size of the image
+     * @return the size of layer 0
+     */
+    Size getSize() const {return getLayers() > 0 ? (*levels)[0].size : Size();}
+    /**
+     * @brief getLaplacian gets a layer of the Laplacian pyramid,
+     * decompressing it if it is not in the working set
+     * @param layer the layer to get
+     * @return the layer, do not modify. Empty if the layer is
+     * not valid.
+     */
+    Mat getLaplacian(int layer) const;
+    /**
+     * @brief toPyramid decompresses all layers into an
+     * ImagePyramid and reconstructs the image
+     * @return the pyramid
+     */
+    ImagePyramid toPyramid() const;
+
+    /* Compression */
+    /**
+     * @brief getRawBytes gets the size of the layers when not
+     * compressed
+     * @return the size in bytes
+     */
+    size_t getRawBytes() const;
+    /**
+     * @brief getCompressedBytes gets the size of the compressed
+     * layers
+     * @return the size in bytes
+     */
+    size_t getCompressedBytes() const;
+    /**
+     * @brief getCompressionRatio gets how many times smaller
+     * the compressed layers are
+     * @return raw bytes divided by compressed bytes
+     */
+    double getCompressionRatio() const;
+
+    /* Working set */
+    /**
+     * @brief setWorkingSetBytes sets the size limit of the
+     * decompressed levels kept for all compressed pyramids
+     * @param bytes the limit in bytes
+     */
+    static void setWorkingSetBytes(size_t bytes);
+    /**
+     * @brief getWorkingSetBytes gets the size limit of the
+     * working set
+     * @return the limit in bytes
+     */
+    static size_t getWorkingSetBytes();
+    /**
+     * @brief getAccessStats gets the accesses to the working set
+     * since the last reset
+     * @return the counts and the time spent decompressing
+     */
+    static AccessStats getAccessStats();
+    /**
+     * @brief resetAccessStats sets the access counts to 0
+     */
+    static void resetAccessStats();
+
+private:
+    /**
+     * @brief The Level struct is one compressed layer
+     */
+    struct Level {
+        Size size;
+        int type;
+        bool packed;                // false if stored raw
+        std::vector<uchar> data;
+    };
+
+    // the compressed data is never modified, so copies share it
+    std::shared_ptr< std::vector<Level> > levels;
+    // the filter of the pyramid, needed to reconstruct it
+    ImagePyramid::Filter filter;
+    // identifies this pyramid's levels in the working set
+    long long id;
+
+    /**
+     * @brief compressLevel compresses a layer
+     * @param src the layer
+     * @param packed if false, the layer is stored raw
+     * @return the compressed layer
+     */
+    static Level compressLevel(const Mat &src, bool packed);
+    /**
+     * @brief decompressLevel decompresses a layer
+     * @param level the compressed layer
+     * @return the layer
+     */
+    static Mat decompressLevel(const Level &level);
+};
+
+#endif // COMPRESSEDPYRAMID_H
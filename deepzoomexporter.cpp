@@ -0,0 +1,178 @@
+#include "deepzoomexporter.h"
+
+#include <QDir>
+#include <QString>
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+/*
+ * Writes the tiles of one level, each tile index in the range
+ * is one tile. Counts the tiles written and the tiles that could
+ * not be written.
+ */
+class TileWriter : public ParallelLoopBody
+{
+public:
+    TileWriter(const Mat &image, const std::string &dir,
+               int tileSize, int overlap, const std::string &format,
+               std::atomic<int> &tiles, std::atomic<int> &failed) :
+        image(image), dir(dir), tileSize(tileSize), overlap(overlap),
+        format(format), tiles(tiles), failed(failed),
+        cols((image.cols + tileSize - 1) / tileSize) {}
+
+    void operator()(const Range &range) const {
+        for (int i = range.start; i < range.end; i++) {
+            int col = i % cols, row = i / cols;
+
+            // each tile includes the overlap on the sides that
+            // have a neighbour
+            int x0 = max(col * tileSize - overlap, 0);
+            int y0 = max(row * tileSize - overlap, 0);
+            int x1 = min((col + 1) * tileSize + overlap, image.cols);
+            int y1 = min((row + 1) * tileSize + overlap, image.rows);
+
+            std::ostringstream name;
+            name << dir << "/" << col << "_" << row << "." << format;
+
+            bool written;
+            try {
+                written = imwrite(name.str(), image(Rect(x0, y0, x1 - x0, y1 - y0)));
+            }
+            catch (const cv::Exception &) {
+                written = false;
+            }
+
+            if (written) {
+                tiles++;
+            }
+            else {
+                failed++;
+            }
+        }
+    }
+
+private:
+    const Mat &image;
+    const std::string &dir;
+    int tileSize;
+    int overlap;
+    const std::string &format;
+    std::atomic<int> &tiles;
+    std::atomic<int> &failed;
+    int cols;
+};
+
+DeepZoomExporter::DeepZoomExporter(
+        const std::string &path, int tileSize,
+        int overlap, const std::string &format) :
+    path(path), tileSize(tileSize), overlap(overlap), format(format),
+    maxLevel(0), smallestLevel(-1), tiles(0), failedTiles(0), seconds(0)
+{
+}
+
+int DeepZoomExporter::begin(const Size &size) {
+
+    if (size.area() == 0) {
+        return 1;
+    }
+
+    this->size = size;
+    smallest.release();
+    smallestLevel = -1;
+    tiles = 0;
+    failedTiles = 0;
+    seconds = 0;
+
+    // the full size level is the first one whose size is
+    // at least the largest dimension
+    maxLevel = 0;
+    while ((1 << maxLevel) < max(size.width, size.height)) {
+        maxLevel++;
+    }
+
+    for (int level = 0; level <= maxLevel; level++) {
+        std::ostringstream dir;
+        dir << path << "_files/" << level;
+        if (!QDir().mkpath(QString::fromStdString(dir.str()))) {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+void DeepZoomExporter::addLevel(int layer, const Mat &gaussian) {
+
+    int level = maxLevel - layer;
+    assert(level >= 0);
+
+    writeLevel(level, gaussian);
+
+    // keep the smallest one for the levels below it
+    if (smallestLevel < 0 || level < smallestLevel) {
+        gaussian.copyTo(smallest);
+        smallestLevel = level;
+    }
+}
+
+ImagePyramid::LevelCallback DeepZoomExporter::callback() {
+    return [this](int layer, const Mat &gaussian) {
+        addLevel(layer, gaussian);
+    };
+}
+
+int DeepZoomExporter::finish() {
+
+    if (smallestLevel < 0) {
+        return 1;
+    }
+
+    // levels smaller than the top layer, downsampled from it
+    for (int level = smallestLevel - 1; level >= 0; level--) {
+        int scale = 1 << (maxLevel - level);
+        Size levelSize((size.width + scale - 1) / scale,
+                       (size.height + scale - 1) / scale);
+
+        Mat image;
+        resize(smallest, image, levelSize, 0, 0, INTER_AREA);
+        writeLevel(level, image);
+    }
+
+    std::ofstream dzi((path + ".dzi").c_str());
+    dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n"
+        << "  Format=\"" << format << "\" Overlap=\"" << overlap
+        << "\" TileSize=\"" << tileSize << "\">\n"
+        << "  <Size Width=\"" << size.width << "\" Height=\"" << size.height << "\"/>\n"
+        << "</Image>\n";
+
+    dzi.close();
+    if (!dzi) {
+        return 2;
+    }
+
+    return failedTiles > 0 ? 3 : 0;
+}
+
+void DeepZoomExporter::writeLevel(int level, const Mat &image) {
+
+    int64 start = getTickCount();
+
+    std::ostringstream dir;
+    dir << path << "_files/" << level;
+    std::string levelDir = dir.str();
+
+    int cols = (image.cols + tileSize - 1) / tileSize;
+    int rows = (image.rows + tileSize - 1) / tileSize;
+
+    std::atomic<int> levelTiles(0), levelFailed(0);
+    parallel_for_(Range(0, cols * rows),
+                  TileWriter(image, levelDir, tileSize, overlap, format,
+                             levelTiles, levelFailed));
+
+    tiles += levelTiles;
+    failedTiles += levelFailed;
+    seconds += (getTickCount() - start) / getTickFrequency();
+}
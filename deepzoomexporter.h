@@ -0,0 +1,114 @@
+#ifndef DEEPZOOMEXPORTER_H
+#define DEEPZOOMEXPORTER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The DeepZoomExporter class writes an image as a Deep
+ * Zoom tile tree: name.dzi describing the image and
+ * name_files/<level>/<col>_<row>.<format> holding the tiles.
+ *
+ * Deep Zoom levels halve the size like pyrDown does, so the
+ * Gaussian layers from ImagePyramid::blend are written directly
+ * as levels instead of building a second pyramid. The levels
+ * smaller than the top layer are downsampled from it. The
+ * tiles of a level are encoded in parallel.
+ *
+ * Use:
+ *     DeepZoomExporter exporter("out/result");
+ *     exporter.begin(size);
+ *     pyramid.blend(src1, src2, mask, exporter.callback());
+ *     exporter.finish();
+ */
+class DeepZoomExporter
+{
+public:
+    /**
+     * @brief DeepZoomExporter creates an exporter
+     * @param path path of the output without extension
+     * @param tileSize width and height of the tiles without
+     * the overlap
+     * @param overlap pixels each tile overlaps its neighbours
+     * @param format image format of the tiles, "jpg" or "png"
+     */
+    DeepZoomExporter(
+            const std::string &path, int tileSize = 254,
+            int overlap = 1, const std::string &format = "jpg");
+
+    /**
+     * @brief begin starts an export and creates the directories
+     * @param size size of the full image
+     * @return 0 if no error, 1 if the size is empty, 2 if the
+     * directories could not be created
+     */
+    int begin(const Size &size);
+    /**
+     * @brief addLevel writes the tiles of a Gaussian layer
+     * @param layer the pyramid layer, 0 is the full size
+     * @param gaussian the image of the layer
+     */
+    void addLevel(int layer, const Mat &gaussian);
+    /**
+     * @brief callback gets a callback for ImagePyramid::blend
+     * that calls addLevel
+     * @return the callback
+     */
+    ImagePyramid::LevelCallback callback();
+    /**
+     * @brief finish writes the levels smaller than the layers
+     * added and the .dzi file
+     * @return 0 if no error, 1 if no layer was added, 2 if the
+     * .dzi file could not be written, 3 if some tiles could not
+     * be written
+     */
+    int finish();
+
+    /**
+     * @brief getTiles gets the number of tiles written
+     * @return the number of tiles
+     */
+    int getTiles() const {return tiles;}
+    /**
+     * @brief getFailedTiles gets the number of tiles that could
+     * not be written
+     * @return the number of tiles
+     */
+    int getFailedTiles() const {return failedTiles;}
+    /**
+     * @brief getSeconds gets the time spent writing tiles
+     * @return the time in seconds
+     */
+    double getSeconds() const {return seconds;}
+
+private:
+    std::string path;
+    int tileSize;
+    int overlap;
+    std::string format;
+
+    Size size;
+    int maxLevel;       // Deep Zoom level of the full size
+
+    // smallest layer added, the smaller levels come from it
+    Mat smallest;
+    int smallestLevel;
+
+    int tiles;
+    int failedTiles;
+    double seconds;
+
+    /**
+     * @brief writeLevel writes the tiles of a Deep Zoom level
+     * @param level the Deep Zoom level
+     * @param image the image of the level
+     */
+    void writeLevel(int level, const Mat &image);
+};
+
+#endif // DEEPZOOMEXPORTER_H
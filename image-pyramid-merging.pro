@@ -9,14 +9,35 @@ CONFIG += c++11
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    autotuner.cpp \
+    backgroundblender.cpp \
+    batchrunner.cpp \
+    blendmask.cpp \
+    commandline.cpp \
+    compressedpyramid.cpp \
+    deepzoomexporter.cpp \
     imagepyramid.cpp \
     main.cpp \
     mainwindow.cpp \
-    selectFiles.cpp
+    memorybudget.cpp \
+    seamfinder.cpp \
+    selectFiles.cpp \
+    sequenceblender.cpp
 
 HEADERS += \
+    autotuner.h \
+    backgroundblender.h \
+    batchrunner.h \
+    blendmask.h \
+    boundedqueue.h \
+    commandline.h \
+    compressedpyramid.h \
+    deepzoomexporter.h \
     imagepyramid.h \
-    mainwindow.h
+    mainwindow.h \
+    memorybudget.h \
+    seamfinder.h \
+    sequenceblender.h
 
 FORMS += \
     mainwindow.ui
@@ -29,6 +50,7 @@ LIBS += C:\tools\OpenCV-3.2.0\opencv-build\bin\libopencv_imgcodecs320.dll
 LIBS += C:\tools\OpenCV-3.2.0\opencv-build\bin\libopencv_imgproc320.dll
 LIBS += C:\tools\OpenCV-3.2.0\opencv-build\bin\libopencv_features2d320.dll
 LIBS += C:\tools\OpenCV-3.2.0\opencv-build\bin\libopencv_calib3d320.dll
+LIBS += C:\tools\OpenCV-3.2.0\opencv-build\bin\libopencv_videoio320.dll
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -1,46 +1,286 @@
 #include "imagepyramid.h"
 
+#include <cstdio>
+#include <cstring>
+
 ImagePyramid::ImagePyramid(const Mat &src, const Size &size) :
     ImagePyramid(src)
 {
     setSize(size);
 }
 
-ImagePyramid::ImagePyramid(const Mat &src) {
+ImagePyramid::ImagePyramid(const Mat &src) :
+    filter(FILTER_BINOMIAL5),
+    lean(false),
+    layerTarget(0)
+{
     setImage(src, true);
 }
 
+ImagePyramid::ImagePyramid(const std::vector<Mat> &laplacianPyr, Filter filter) :
+    laplacianPyr(laplacianPyr),
+    filter(filter),
+    lean(false),
+    layerTarget(0)
+{
+    if (!laplacianPyr.empty()) {
+        // reconstruct image and set both resizedImage and image
+        reconstructImage();
+        updateReservation();
+    }
+}
+
 ImagePyramid::ImagePyramid(
         const ImagePyramid &src1,
         const ImagePyramid &src2,
         const Mat &src1Mask
+        ) :
+    ImagePyramid(src1, src2, BlendMask(src1Mask))
+{
+}
+
+ImagePyramid::ImagePyramid(
+        const ImagePyramid &src1,
+        const ImagePyramid &src2,
+        const BlendMask &src1Mask
+        ) :
+    filter(FILTER_BINOMIAL5),
+    lean(false),
+    layerTarget(0)
+{
+    blend(src1, src2, src1Mask);
+}
+
+void ImagePyramid::blend(
+        const ImagePyramid &src1,
+        const ImagePyramid &src2,
+        const BlendMask &src1Mask,
+        const LevelCallback &onLevel
         ) {
 
-    assert(src1Mask.cols == src1.getWidth() && src1Mask.rows == src1.getHeight());
+    assert(src1Mask.getSize() == src1.getSize());
+    assert(src1.getLayers() == src2.getLayers());
+    assert(src1.filter == src2.filter);
+
+    // The fused blend does not need memory for the blended
+    // layers, only for the image and the working memory
+    size_t needed = scratchBytes(src1.laplacianPyr);
+    size_t held = image.total() * image.elemSize() + scratch.buffer.total();
+    for (int layer = 0; layer < src1.getLayers(); layer++) {
+        needed += src1.laplacianPyr[layer].total() * src1.laplacianPyr[layer].elemSize();
+    }
+    needed += src1.laplacianPyr[0].total() * src1.laplacianPyr[0].elemSize();
+    for (int layer = 0; layer < getLayers(); layer++) {
+        held += laplacianPyr[layer].total() * laplacianPyr[layer].elemSize();
+    }
+    if (lean || !MemoryBudget::fits(needed > held ? needed - held : 0)) {
+        blendFused(src1, src2, src1Mask, onLevel);
+        return;
+    }
+
+    // the layers are collapsed with the filter they were made with
+    filter = src1.filter;
+
+    // compute the mask levels, the copy shares the caller's data
+    BlendMask mask = src1Mask;
+    mask.setLevels(src1.getLayers());
 
-    Mat mask = src1Mask.clone();  // so it can be modified
+    // keeps the existing level buffers, unless they are shared,
+    // which includes a copy of src1 or src2 being blended into
+    laplacianPyr.resize(src1.getLayers());
+    unshareLayers();
 
     //combine pyramids
     for (int layer = 0; layer < src1.getLayers(); layer++) {
 
-        Mat src1Lap = src1.getLaplacian(layer);
-        Mat src2Lap = src2.getLaplacian(layer);
-
-        laplacianPyr.push_back(
-                    addMaskedLaplacian(
-                        src1Lap,
-                        src2Lap,
-                        mask
-                        )
+        addMaskedLaplacian(
+                    src1.laplacianPyr[layer],
+                    src2.laplacianPyr[layer],
+                    mask, layer,
+                    laplacianPyr[layer]
                     );
 
-        // downsize mask to fit next layer
-        pyrDown(mask, mask);
-
     }
 
     // reconstruct image and set both resizedImage and image
-    reconstructImage();
+    reconstructImage(onLevel);
+
+    updateReservation();
+}
+
+void ImagePyramid::blendFused(
+        const ImagePyramid &src1,
+        const ImagePyramid &src2,
+        const BlendMask &src1Mask,
+        const LevelCallback &onLevel
+        ) {
+
+    assert(src1Mask.getSize() == src1.getSize());
+    assert(src1.getLayers() == src2.getLayers());
+    assert(src1.filter == src2.filter);
+
+    int layers = src1.getLayers();
+    const std::vector<Mat> &layers1 = src1.laplacianPyr;
+    const std::vector<Mat> &layers2 = src2.laplacianPyr;
+
+    // the layers are collapsed with the filter they were made with
+    filter = src1.filter;
+
+    // compute the mask levels, the copy shares the caller's data
+    BlendMask mask = src1Mask;
+    mask.setLevels(layers);
+
+    // the blended layers are never stored
+    laplacianPyr.clear();
+
+    // The Gaussian layers above 0 alternate between the two
+    // parts of the scratch buffer, odd layers first, like in
+    // reconstructImage
+    int type = layers1.back().type();
+    reserveScratch(layers1);
+    size_t layer1Bytes = layers > 1 ? layers1[1].total() * layers1[1].elemSize() : 0;
+
+    Mat gaussian;
+
+    // from the top layer down
+    for (int layer = layers-1; layer >= 0; layer--) {
+        Mat level;
+        if (layer == 0) {
+            // the last one goes straight into the image
+            unshareImage();
+            image.create(layers1[0].size(), type);
+            level = image;
+        }
+        else {
+            level = levelView(
+                        scratch.buffer, layer % 2 == 1 ? 0 : layer1Bytes,
+                        layers1[layer].size(), type);
+        }
+
+        if (layer == layers-1) {
+            // the top layer is Gaussian, it starts the image
+            addMaskedLaplacian(layers1[layer], layers2[layer], mask, layer, level);
+        }
+        else {
+            // upscale and add the blended layer
+            upsample(gaussian, level, level.size(), filter);
+            addMaskedLaplacian(layers1[layer], layers2[layer], mask, layer, level, true);
+        }
+        gaussian = level;
+
+        if (onLevel) {
+            onLevel(layer, gaussian);
+        }
+    }
+
+    if (lean) {
+        scratch.buffer.release();
+    }
+
+    // set image and resizedImage without using setters. The
+    // getters copy, so they can share the data.
+    resizedImage = image;
+    imageSize = image.size();
+
+    updateReservation();
+}
+
+Mat ImagePyramid::blendRegion(
+        const ImagePyramid &src1,
+        const ImagePyramid &src2,
+        const BlendMask &src1Mask,
+        const Rect &roi,
+        double scale
+        ) {
+
+    assert(src1Mask.getSize() == src1.getSize());
+    assert(src1.getLayers() == src2.getLayers());
+    assert(src1.filter == src2.filter);
+
+    Rect region = roi & Rect(Point(0, 0), src1.getSize());
+    if (region.area() == 0 || scale <= 0 || src1.getLayers() == 0) {
+        return Mat();   // empty matrix
+    }
+
+    int layers = src1.getLayers();
+    const std::vector<Mat> &layers1 = src1.laplacianPyr;
+    const std::vector<Mat> &layers2 = src2.laplacianPyr;
+
+    // the mask keeps its levels if it already has them
+    BlendMask mask = src1Mask;
+    mask.setLevels(layers);
+
+    // the smallest layer that still has the resolution needed
+    int finest = 0;
+    while (finest < layers-1 && scale * (2 << finest) <= 1) {
+        finest++;
+    }
+
+    // The area of each layer needed. Each layer needs the area
+    // below it halved, plus one pixel on each side for the
+    // upsampling filter.
+    std::vector<Rect> footprint(layers);
+    footprint[finest] = Rect(
+                Point(region.x >> finest, region.y >> finest),
+                Point((region.x + region.width + (1 << finest) - 1) >> finest,
+                      (region.y + region.height + (1 << finest) - 1) >> finest))
+            & Rect(Point(0, 0), layers1[finest].size());
+    for (int layer = finest+1; layer < layers; layer++) {
+        const Rect &below = footprint[layer-1];
+        footprint[layer] = Rect(
+                    Point(below.x / 2 - 1, below.y / 2 - 1),
+                    Point((below.x + below.width - 1) / 2 + 2,
+                          (below.y + below.height - 1) / 2 + 2))
+                & Rect(Point(0, 0), layers1[layer].size());
+    }
+
+    // the top layer is Gaussian, it starts the image
+    int top = layers-1;
+    const Rect &topArea = footprint[top];
+    Mat gaussian;
+    addMaskedLaplacian(
+                layers1[top](topArea), layers2[top](topArea),
+                mask, top, gaussian, false, topArea.tl());
+
+    for (int layer = top-1; layer >= finest; layer--) {
+        const Rect &upper = footprint[layer+1];
+        const Rect &area = footprint[layer];
+
+        // The upsampled border pixels are wrong where the upper
+        // area was cut, but the area is far enough inside
+        Mat upscaled;
+        upsample(gaussian, upscaled, Size(upper.width * 2, upper.height * 2), src1.filter);
+        gaussian = upscaled(Rect(area.x - 2 * upper.x, area.y - 2 * upper.y,
+                                 area.width, area.height));
+
+        addMaskedLaplacian(
+                    layers1[layer](area), layers2[layer](area),
+                    mask, layer, gaussian, true, area.tl());
+    }
+
+    Size outputSize(max(cvRound(region.width * scale), 1),
+                    max(cvRound(region.height * scale), 1));
+    if (gaussian.size() == outputSize) {
+        return gaussian.clone();
+    }
+
+    Mat output;
+    resize(gaussian, output, outputSize, 0, 0, scale < 1 ? INTER_AREA : INTER_LINEAR);
+    return output;
+}
+
+Mat ImagePyramid::getImage() const {
+    if (image.empty() && getLayers() > 0) {
+        return getGaussian(0);
+    }
+    return image.clone();
+}
+
+Mat ImagePyramid::getResizedImage() const {
+    if (resizedImage.empty() && getLayers() > 0) {
+        return getGaussian(0);
+    }
+    return resizedImage.clone();
 }
 
 int ImagePyramid::setImage(const Mat &src, bool keepSize) {
@@ -48,6 +288,7 @@ int ImagePyramid::setImage(const Mat &src, bool keepSize) {
         return 1;   // error
     }
     else {
+        unshareImage();
         src.copyTo(image);
 
         // keepsize = slightly change to add more layers
@@ -74,8 +315,7 @@ int ImagePyramid::setSize (const Size &size) {
     }
     else {
         this->imageSize = size;
-        resizeImage();
-        generatePyramid();  // generates Laplacian pyramid
+        resizeImage();      // also generates Laplacian pyramid
         return 0;
     }
 }
@@ -88,6 +328,14 @@ int ImagePyramid::setLayers(int layers) {
         return 1;
     }
     else {
+        // images set later are built with this many layers
+        layerTarget = layers;
+
+        // a lean blended pyramid only has the image
+        if (getLayers() == 0) {
+            generatePyramid();
+        }
+
         if (layers == getLayers()); // do nothing
         else if (layers < getLayers()) {
             // shrink pyramid
@@ -101,29 +349,104 @@ int ImagePyramid::setLayers(int layers) {
                 expandPyramid();
             }
         }
+        updateReservation();
         return 0;
     }
 }
 
+void ImagePyramid::setFilter(Filter filter) {
+
+    if (filter == this->filter) {
+        return;
+    }
+
+    int layers = getLayers();
+    if (layers == 0) {
+        this->filter = filter;
+        return;
+    }
+
+    // a lean pyramid gets its image back with the old filter
+    if (resizedImage.empty()) {
+        image = getGaussian(0);
+        resizedImage = image;
+    }
+
+    this->filter = filter;
+    generatePyramid();
+
+    // keep the number of layers
+    setLayers(layers);
+}
+
 void ImagePyramid::generatePyramid() {
 
-    // Save number of layers
-    // unsigned int layers = getLayers();
+    // The number of layers last set, or the maximum. Building
+    // only those layers keeps the buffers of the layers from
+    // the last image, instead of building more and dropping them.
+    int layers = maxLayers();
+    if (layerTarget > 0) {
+        layers = min(layers, layerTarget);
+    }
 
-    // Use the maximum number of layers always
-    unsigned int layers = maxLayers();
+    // Keep the existing layers so their buffers can be reused
+    laplacianPyr.resize(layers);
+    unshareLayers();
 
-    // Start from scratch
-    laplacianPyr.clear();
+    if (layers == 1) {
+        resizedImage.copyTo(laplacianPyr[0]);
+    }
+    else {
+        buildLayers();
+    }
+
+    // A lean pyramid, or one that does not fit in the memory
+    // budget, only keeps the layers
+    updateReservation();
+    if (lean || !MemoryBudget::fits(0)) {
+        releaseUnneeded();
+        updateReservation();
+    }
+
+}
 
-    // Add resized image as layer 0
-    // changed to CV_8S
-    Mat layer0;
-    laplacianPyr.push_back(resizedImage.clone());
+void ImagePyramid::buildLayers() {
 
-    // Expand pyramd until there are enough layers
-    while (laplacianPyr.size() < layers) {
-        expandPyramid();
+    int layers = getLayers();
+    int type = resizedImage.type();
+    int laplacianType = CV_MAKETYPE(CV_8S, resizedImage.channels());
+
+    // Allocate the layers. create() does nothing if a layer
+    // already has the right size and type, so building a
+    // pyramid of the same size again does not allocate.
+    Size size = resizedImage.size();
+    for (int layer = 0; layer < layers; layer++) {
+        // the last layer is Gaussian, the others are CV_8S
+        laplacianPyr[layer].create(
+                    size, layer == layers-1 ? type : laplacianType);
+        size = Size((size.width + 1) / 2, (size.height + 1) / 2);
+    }
+    reserveScratch(laplacianPyr);
+
+    // Build the Gaussian pyramid in the buffers of the Laplacian
+    // layers, layer 0 is the resized image
+    std::vector<Mat> gaussianPyr(layers);
+    gaussianPyr[0] = resizedImage;
+    for (int layer = 1; layer < layers; layer++) {
+        gaussianPyr[layer] = levelView(
+                    laplacianPyr[layer], 0, laplacianPyr[layer].size(), type);
+        downsample(gaussianPyr[layer-1], gaussianPyr[layer], gaussianPyr[layer].size(), filter);
+    }
+
+    // Replace each Gaussian layer with its Laplacian in place.
+    // Layer 0 is upscaled into its own buffer, the others into
+    // the scratch buffer.
+    for (int layer = 0; layer < layers-1; layer++) {
+        Mat upscaled = levelView(
+                    layer == 0 ? laplacianPyr[0] : scratch.buffer, 0,
+                    laplacianPyr[layer].size(), type);
+        upsample(gaussianPyr[layer+1], upscaled, upscaled.size(), filter);
+        subtract(gaussianPyr[layer], upscaled, laplacianPyr[layer], noArray(), CV_8S);
     }
 
 }
@@ -133,10 +456,11 @@ void ImagePyramid::expandPyramid() {
     laplacianPyr.pop_back();
 
     Mat layer2;
-    pyrDown(layer1, layer2);
+    downsample(layer1, layer2,
+               Size((layer1.cols + 1) / 2, (layer1.rows + 1) / 2), filter);
 
     Mat layer2Upscaled;
-    pyrUp(layer2, layer2Upscaled);
+    upsample(layer2, layer2Upscaled, layer1.size(), filter);
 
     Mat layer1Laplacian;
     subtract(layer1, layer2Upscaled, layer1Laplacian, noArray(), CV_8S);
@@ -147,28 +471,806 @@ void ImagePyramid::expandPyramid() {
 }
 
 void ImagePyramid::shrinkPyramid() {
-    Mat layer1 = laplacianPyr.back();
-    laplacianPyr.pop_back();
     Mat layer2 = laplacianPyr.back();
     laplacianPyr.pop_back();
+    Mat layer1Laplacian = laplacianPyr.back();
+    laplacianPyr.pop_back();
+
+    // collapse the last Gaussian layer into the one before it
+    Mat layer2Upscaled;
+    upsample(layer2, layer2Upscaled, layer1Laplacian.size(), filter);
+
+    Mat layer1;
+    add(layer2Upscaled, layer1Laplacian, layer1, noArray(), layer2.type());
+
+    laplacianPyr.push_back(layer1);
+}
+
+void ImagePyramid::reserveScratch(const std::vector<Mat> &layers) {
+    scratch.buffer.create(1, (int) scratchBytes(layers), CV_8U);
+}
+
+size_t ImagePyramid::scratchBytes(const std::vector<Mat> &layers) {
+
+    // large enough for layer 1 followed by layer 2
+    size_t bytes = 0;
+    for (size_t layer = 1; layer <= 2 && layer < layers.size(); layer++) {
+        bytes += layers[layer].total() * layers[layer].elemSize();
+    }
+
+    return bytes;
+}
+
+void ImagePyramid::unshare(Mat &buffer, int references) {
+    // data from outside OpenCV has no reference count
+    if (!buffer.empty() && (!buffer.u || buffer.u->refcount > references)) {
+        buffer.release();
+    }
+}
+
+Mat ImagePyramid::levelView(
+        const Mat &buffer, size_t offset,
+        const Size &size, int type) {
+
+    assert(offset + size.area() * CV_ELEM_SIZE(type) <= buffer.total() * buffer.elemSize());
+
+    return Mat(size, type, buffer.data + offset);
+}
+
+/* Filters */
+
+/*
+ * Reflects an index outside [0, n) like BORDER_REFLECT_101
+ */
+static inline int reflect101(int i, int n) {
+    if (n == 1) return 0;
+    if (i < 0) return -i;
+    if (i >= n) return 2 * n - 2 - i;
+    return i;
+}
+
+/*
+ * The horizontal passes below run over the columns whose
+ * neighbours are all inside the row without any border checks.
+ * CN is the number of channels, so for one and three channels
+ * the inner loop is unrolled and the loop over the columns is a
+ * plain strided sum the compiler vectorizes. CN is 0 for other
+ * numbers of channels, which are passed in cn. The columns at
+ * the borders are done one pixel at a time.
+ */
+
+/*
+ * Horizontal pass of downsampleBinomial3 for one column, with
+ * the border reflected
+ */
+static inline void downsampleBinomial3Pixel(
+        const ushort *v, uchar *out, int x, int cols, int cn) {
+    int left = reflect101(2 * x - 1, cols) * cn;
+    int center = 2 * x * cn;
+    int right = reflect101(2 * x + 1, cols) * cn;
+    for (int c = 0; c < cn; c++) {
+        out[x * cn + c] = (uchar) ((v[left + c] + 2 * v[center + c] + v[right + c] + 8) >> 4);
+    }
+}
+
+/*
+ * Horizontal pass of downsampleBinomial3 for the columns in
+ * [start, end), whose neighbours must be inside the row
+ */
+template <int CN>
+static void downsampleBinomial3Span(
+        const ushort *v, uchar *out, int start, int end, int cn) {
+    const int channels = CN > 0 ? CN : cn;
+    for (int x = start; x < end; x++) {
+        const ushort *p = v + 2 * x * channels;
+        uchar *o = out + x * channels;
+        for (int c = 0; c < channels; c++) {
+            o[c] = (uchar) ((p[c - channels] + 2 * p[c] + p[c + channels] + 8) >> 4);
+        }
+    }
+}
+
+/*
+ * 3x3 binomial [1 2 1] downsampling. The vertical pass sums
+ * three rows in 16 bits, then the horizontal pass sums three
+ * columns of every second pixel.
+ */
+static void downsampleBinomial3(const Mat &src, Mat &dst) {
+
+    int cn = src.channels();
+    int n = src.cols * cn;
+    std::vector<ushort> sums(n);
+    ushort *v = sums.data();
+
+    // the columns of dst whose right neighbour is inside src,
+    // all but the first have their left neighbour too
+    int inner = max(min(src.cols / 2, dst.cols), 1);
+
+    for (int y = 0; y < dst.rows; y++) {
+        const uchar *row0 = src.ptr(reflect101(2 * y - 1, src.rows));
+        const uchar *row1 = src.ptr(2 * y);
+        const uchar *row2 = src.ptr(reflect101(2 * y + 1, src.rows));
+
+        for (int i = 0; i < n; i++) {
+            v[i] = row0[i] + 2 * row1[i] + row2[i];
+        }
+
+        uchar *out = dst.ptr(y);
+        downsampleBinomial3Pixel(v, out, 0, src.cols, cn);
+
+        switch (cn) {
+        case 1:     downsampleBinomial3Span<1>(v, out, 1, inner, cn); break;
+        case 3:     downsampleBinomial3Span<3>(v, out, 1, inner, cn); break;
+        default:    downsampleBinomial3Span<0>(v, out, 1, inner, cn); break;
+        }
+
+        for (int x = inner; x < dst.cols; x++) {
+            downsampleBinomial3Pixel(v, out, x, src.cols, cn);
+        }
+    }
+}
+
+/*
+ * Horizontal pass of upsampleBinomial3 for one column, with the
+ * last pixel repeated at the border
+ */
+static inline void upsampleBinomial3Pixel(
+        const ushort *v, uchar *out, int x, int cols, int cn) {
+    int a = (x / 2) * cn;
+    int b = min((x + 1) / 2, cols - 1) * cn;
+    for (int c = 0; c < cn; c++) {
+        out[x * cn + c] = (uchar) ((v[a + c] + v[b + c] + 2) >> 2);
+    }
+}
+
+/*
+ * Horizontal pass of upsampleBinomial3 for the pairs of columns
+ * 2i and 2i + 1 with i in [0, end). Pixel i + 1 must be inside
+ * the row.
+ */
+template <int CN>
+static void upsampleBinomial3Span(const ushort *v, uchar *out, int end, int cn) {
+    const int channels = CN > 0 ? CN : cn;
+    for (int i = 0; i < end; i++) {
+        const ushort *p = v + i * channels;
+        uchar *o = out + 2 * i * channels;
+        for (int c = 0; c < channels; c++) {
+            o[c] = (uchar) ((2 * p[c] + 2) >> 2);
+            o[c + channels] = (uchar) ((p[c] + p[c + channels] + 2) >> 2);
+        }
+    }
+}
+
+/*
+ * Linear upsampling, the transpose of the 3x3 binomial. Even
+ * rows and columns copy a pixel, odd ones are the mean of two.
+ */
+static void upsampleBinomial3(const Mat &src, Mat &dst) {
+
+    int cn = src.channels();
+    int n = src.cols * cn;
+    std::vector<ushort> sums(n);
+    ushort *v = sums.data();
+
+    // the pairs of dst columns inside dst whose odd column has
+    // both neighbours inside src
+    int pairs = min(src.cols - 1, dst.cols / 2);
+
+    for (int y = 0; y < dst.rows; y++) {
+        // the same row twice for even rows
+        const uchar *row0 = src.ptr(min(y / 2, src.rows - 1));
+        const uchar *row1 = src.ptr(min((y + 1) / 2, src.rows - 1));
+
+        for (int i = 0; i < n; i++) {
+            v[i] = row0[i] + row1[i];
+        }
+
+        uchar *out = dst.ptr(y);
+        switch (cn) {
+        case 1:     upsampleBinomial3Span<1>(v, out, pairs, cn); break;
+        case 3:     upsampleBinomial3Span<3>(v, out, pairs, cn); break;
+        default:    upsampleBinomial3Span<0>(v, out, pairs, cn); break;
+        }
+
+        for (int x = 2 * pairs; x < dst.cols; x++) {
+            upsampleBinomial3Pixel(v, out, x, src.cols, cn);
+        }
+    }
+}
+
+/*
+ * Horizontal pass of downsampleBox2 for one column, with the
+ * last pixel repeated at the border
+ */
+static inline void downsampleBox2Pixel(
+        const ushort *v, uchar *out, int x, int cols, int cn) {
+    int a = 2 * x * cn;
+    int b = min(2 * x + 1, cols - 1) * cn;
+    for (int c = 0; c < cn; c++) {
+        out[x * cn + c] = (uchar) ((v[a + c] + v[b + c] + 2) >> 2);
+    }
+}
+
+/*
+ * Horizontal pass of downsampleBox2 for the columns in [0, end),
+ * whose right neighbour must be inside the row
+ */
+template <int CN>
+static void downsampleBox2Span(const ushort *v, uchar *out, int end, int cn) {
+    const int channels = CN > 0 ? CN : cn;
+    for (int x = 0; x < end; x++) {
+        const ushort *p = v + 2 * x * channels;
+        uchar *o = out + x * channels;
+        for (int c = 0; c < channels; c++) {
+            o[c] = (uchar) ((p[c] + p[c + channels] + 2) >> 2);
+        }
+    }
+}
+
+/*
+ * 2x2 mean downsampling
+ */
+static void downsampleBox2(const Mat &src, Mat &dst) {
+
+    int cn = src.channels();
+    int n = src.cols * cn;
+    std::vector<ushort> sums(n);
+    ushort *v = sums.data();
+
+    // the columns of dst whose right neighbour is inside src
+    int inner = min(src.cols / 2, dst.cols);
+
+    for (int y = 0; y < dst.rows; y++) {
+        const uchar *row0 = src.ptr(2 * y);
+        const uchar *row1 = src.ptr(min(2 * y + 1, src.rows - 1));
+
+        for (int i = 0; i < n; i++) {
+            v[i] = row0[i] + row1[i];
+        }
+
+        uchar *out = dst.ptr(y);
+        switch (cn) {
+        case 1:     downsampleBox2Span<1>(v, out, inner, cn); break;
+        case 3:     downsampleBox2Span<3>(v, out, inner, cn); break;
+        default:    downsampleBox2Span<0>(v, out, inner, cn); break;
+        }
+
+        for (int x = inner; x < dst.cols; x++) {
+            downsampleBox2Pixel(v, out, x, src.cols, cn);
+        }
+    }
+}
+
+/*
+ * Nearest upsampling of a row for the pairs of columns 2i and
+ * 2i + 1 with i in [0, end)
+ */
+template <int CN>
+static void upsampleBox2Span(const uchar *row, uchar *out, int end, int cn) {
+    const int channels = CN > 0 ? CN : cn;
+    for (int i = 0; i < end; i++) {
+        const uchar *p = row + i * channels;
+        uchar *o = out + 2 * i * channels;
+        for (int c = 0; c < channels; c++) {
+            o[c] = p[c];
+            o[c + channels] = p[c];
+        }
+    }
+}
+
+/*
+ * Nearest upsampling, the transpose of the 2x2 mean
+ */
+static void upsampleBox2(const Mat &src, Mat &dst) {
+
+    int cn = src.channels();
+
+    // the pairs of dst columns inside dst and src
+    int pairs = min(src.cols, dst.cols / 2);
+
+    for (int y = 0; y < dst.rows; y++) {
+        const uchar *row = src.ptr(min(y / 2, src.rows - 1));
+        uchar *out = dst.ptr(y);
+
+        switch (cn) {
+        case 1:     upsampleBox2Span<1>(row, out, pairs, cn); break;
+        case 3:     upsampleBox2Span<3>(row, out, pairs, cn); break;
+        default:    upsampleBox2Span<0>(row, out, pairs, cn); break;
+        }
+
+        for (int x = 2 * pairs; x < dst.cols; x++) {
+            const uchar *pixel = row + min(x / 2, src.cols - 1) * cn;
+            for (int c = 0; c < cn; c++) {
+                out[x * cn + c] = pixel[c];
+            }
+        }
+    }
+}
+
+void ImagePyramid::downsample(
+        const Mat &src, Mat &dst, const Size &size, Filter filter) {
+
+    if (filter == FILTER_BINOMIAL5) {
+        pyrDown(src, dst, size);
+        return;
+    }
+
+    assert(src.depth() == CV_8U);
+    assert(size.width * 2 <= src.cols + 1 && size.height * 2 <= src.rows + 1);
+
+    // keep the source alive if dst is the same image
+    Mat source = src;
+    dst.create(size, source.type());
+
+    if (filter == FILTER_BINOMIAL3) {
+        downsampleBinomial3(source, dst);
+    }
+    else {
+        downsampleBox2(source, dst);
+    }
+}
+
+void ImagePyramid::upsample(
+        const Mat &src, Mat &dst, const Size &size, Filter filter) {
+
+    if (filter == FILTER_BINOMIAL5) {
+        pyrUp(src, dst, size);
+        return;
+    }
+
+    assert(src.depth() == CV_8U);
+    assert(size.width <= src.cols * 2 && size.height <= src.rows * 2);
+
+    // keep the source alive if dst is the same image
+    Mat source = src;
+    dst.create(size, source.type());
+
+    if (filter == FILTER_BINOMIAL3) {
+        upsampleBinomial3(source, dst);
+    }
+    else {
+        upsampleBox2(source, dst);
+    }
+}
+
+void ImagePyramid::setLean(bool lean) {
+    this->lean = lean;
+    if (lean) {
+        releaseUnneeded();
+        updateReservation();
+    }
+}
+
+void ImagePyramid::releaseUnneeded() {
+    scratch.buffer.release();
+
+    // the image can be reconstructed from the layers
+    if (getLayers() > 0) {
+        image.release();
+        resizedImage.release();
+    }
+}
+
+size_t ImagePyramid::MemoryUsage::total() const {
+    size_t bytes = image + resizedImage + scratch;
+    for (size_t i = 0; i < levels.size(); i++) {
+        bytes += levels[i];
+    }
+    return bytes;
+}
+
+ImagePyramid::MemoryUsage ImagePyramid::memoryUsage() const {
+
+    MemoryUsage usage;
+    usage.image = image.total() * image.elemSize();
+    usage.resizedImage = resizedImage.data == image.data ?
+                0 : resizedImage.total() * resizedImage.elemSize();
+    for (int layer = 0; layer < getLayers(); layer++) {
+        usage.levels.push_back(
+                    laplacianPyr[layer].total() * laplacianPyr[layer].elemSize());
+    }
+    usage.scratch = scratch.buffer.total();
+
+    return usage;
+}
+
+ImagePyramid::MemoryUsage ImagePyramid::estimateMemoryUsage(
+        const Size &size, int type, bool lean) {
+
+    MemoryUsage usage;
+
+    // the Laplacian layers have the element size of the image
+    size_t elemSize = CV_ELEM_SIZE(type);
+    int layers = maxLayers(size);
+    Size levelSize = size;
+    for (int layer = 0; layer < layers; layer++) {
+        usage.levels.push_back(levelSize.area() * elemSize);
+        levelSize = Size((levelSize.width + 1) / 2, (levelSize.height + 1) / 2);
+    }
+
+    // the resized image shares the image when it has the size
+    usage.image = lean ? 0 : size.area() * elemSize;
+    usage.resizedImage = 0;
+
+    usage.scratch = 0;
+    for (int layer = 1; !lean && layer <= 2 && layer < layers; layer++) {
+        usage.scratch += usage.levels[layer];
+    }
+
+    return usage;
+}
+
+/* The tuning of all pyramids */
+static ImagePyramid::Tuning tuning = ImagePyramid::defaultTuning();
+
+ImagePyramid::Tuning ImagePyramid::defaultTuning() {
+    Tuning defaults = {0, 32, 4, BLEND_KERNEL_PIXEL};
+    return defaults;
+}
+
+void ImagePyramid::setTuning(const Tuning &newTuning) {
+
+    tuning = newTuning;
+    tuning.threads = max(tuning.threads, 0);
+    tuning.maskTileSize = min(max(tuning.maskTileSize, 8), 1024);
+    tuning.stripeTiles = max(tuning.stripeTiles, 0);
+    if (tuning.blendKernel != BLEND_KERNEL_EXPANDED) {
+        tuning.blendKernel = BLEND_KERNEL_PIXEL;
+    }
+
+    // a negative number is OpenCV's default
+    setNumThreads(tuning.threads > 0 ? tuning.threads : -1);
+}
+
+ImagePyramid::Tuning ImagePyramid::getTuning() {
+    return tuning;
+}
+
+int ImagePyramid::loadTuning(const std::string &path, const std::string &machine) {
+
+    Tuning loaded = defaultTuning();
+    std::string tunedMachine;
+    std::string kernel;
+
+    try {
+        FileStorage profile(path, FileStorage::READ);
+        if (!profile.isOpened()) {
+            return 1;
+        }
+
+        // a missing key reads as 0, so only the keys present
+        // replace the defaults
+        profile["machine"] >> tunedMachine;
+        if (!profile["threads"].empty()) {
+            profile["threads"] >> loaded.threads;
+        }
+        if (!profile["maskTileSize"].empty()) {
+            profile["maskTileSize"] >> loaded.maskTileSize;
+        }
+        if (!profile["stripeTiles"].empty()) {
+            profile["stripeTiles"] >> loaded.stripeTiles;
+        }
+        if (!profile["blendKernel"].empty()) {
+            profile["blendKernel"] >> kernel;
+        }
+    }
+    catch (const cv::Exception &) {
+        return 1;
+    }
+
+    // tuned for another machine
+    if (tunedMachine != machine) {
+        return 2;
+    }
+
+    if (kernel == "expanded") {
+        loaded.blendKernel = BLEND_KERNEL_EXPANDED;
+    }
+    else if (kernel == "pixel") {
+        loaded.blendKernel = BLEND_KERNEL_PIXEL;
+    }
+    setTuning(loaded);
+
+    return 0;
+}
+
+int ImagePyramid::saveTuning(const std::string &path, const std::string &machine) {
+
+    std::string temp = path + ".tmp";
+
+    try {
+        FileStorage profile(temp, FileStorage::WRITE);
+        if (!profile.isOpened()) {
+            return 1;
+        }
+
+        profile << "machine" << machine;
+        profile << "threads" << tuning.threads;
+        profile << "maskTileSize" << tuning.maskTileSize;
+        profile << "stripeTiles" << tuning.stripeTiles;
+        profile << "blendKernel"
+                << (tuning.blendKernel == BLEND_KERNEL_EXPANDED ? "expanded" : "pixel");
+    }
+    catch (const cv::Exception &) {
+        std::remove(temp.c_str());
+        return 1;
+    }
+
+    // rename does not replace an existing file on every system
+    if (std::rename(temp.c_str(), path.c_str()) != 0 &&
+            (std::remove(path.c_str()) != 0 ||
+             std::rename(temp.c_str(), path.c_str()) != 0)) {
+        std::remove(temp.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+Mat ImagePyramid::classifyMask(
+        const BlendMask &mask, int layer,
+        const Rect &area, int tileSize) {
+
+    Size size = mask.getSize(layer);
+
+    int tileRows = (area.height + tileSize - 1) / tileSize;
+    int tileCols = (area.width + tileSize - 1) / tileSize;
+
+    Mat regions(tileRows, tileCols, CV_8UC1);
+
+    for (int ty = 0; ty < tileRows; ty++) {
+        for (int tx = 0; tx < tileCols; tx++) {
+
+            Rect tile(area.x + tx * tileSize, area.y + ty * tileSize,
+                      tileSize, tileSize);
+            tile &= area & Rect(Point(0, 0), size);
+
+            float lo, hi;
+            mask.getRange(layer, tile, lo, hi);
+
+            uchar region = REGION_MIXED;
+            if (lo == 1.0f && hi == 1.0f) region = REGION_SRC1;
+            else if (lo == 0.0f && hi == 0.0f) region = REGION_SRC2;
+
+            regions.at<uchar>(ty, tx) = region;
+        }
+    }
+
+    return regions;
+}
+
+/*
+ * Blends one span of a row: dst = src1 * mask + src2 * (1 - mask)
+ */
+template <typename T>
+static void blendSpan(
+        const T *src1, const T *src2, const float *mask,
+        T *dst, int cols, int channels) {
+
+    for (int col = 0; col < cols; col++) {
+
+        // mask values
+        float leftMaskValue = mask[col];
+        float rightMaskValue = 1 - leftMaskValue;
+
+        for (int c = 0; c < channels; c++) {
+            int i = col * channels + c;
+            dst[i] = (T)(src1[i] * leftMaskValue + src2[i] * rightMaskValue);
+        }
+    }
+}
+
+/*
+ * Adds a span of a signed layer to an image
+ */
+static void addSpan(const schar *src, uchar *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = saturate_cast<uchar>(dst[i] + src[i]);
+    }
+}
+
+/*
+ * Blends one span of a row of signed layers and adds it to an
+ * image, the same as blendSpan followed by addSpan
+ */
+static void blendAddSpan(
+        const schar *src1, const schar *src2, const float *mask,
+        uchar *dst, int cols, int channels) {
+
+    for (int col = 0; col < cols; col++) {
+
+        // mask values
+        float leftMaskValue = mask[col];
+        float rightMaskValue = 1 - leftMaskValue;
+
+        for (int c = 0; c < channels; c++) {
+            int i = col * channels + c;
+            schar value = (schar)(src1[i] * leftMaskValue + src2[i] * rightMaskValue);
+            dst[i] = saturate_cast<uchar>(dst[i] + value);
+        }
+    }
+}
+
+/*
+ * Repeats each mask value for every channel, so the expanded
+ * kernels run one flat loop the compiler can vectorize
+ */
+static void expandSpan(const float *mask, float *weights, int cols, int channels) {
+    for (int col = 0; col < cols; col++) {
+        for (int c = 0; c < channels; c++) {
+            weights[col * channels + c] = mask[col];
+        }
+    }
+}
+
+/*
+ * blendSpan with an expanded mask, n is the number of elements
+ */
+template <typename T>
+static void blendSpanExpanded(
+        const T *src1, const T *src2, const float *weights,
+        T *dst, int n) {
 
-    pyrUp(layer2, layer2);
+    for (int i = 0; i < n; i++) {
+        dst[i] = (T)(src1[i] * weights[i] + src2[i] * (1 - weights[i]));
+    }
+}
 
-    Mat layer1New;
-    subtract(layer1, layer2, layer1New);
+/*
+ * blendAddSpan with an expanded mask, n is the number of elements
+ */
+static void blendAddSpanExpanded(
+        const schar *src1, const schar *src2, const float *weights,
+        uchar *dst, int n) {
 
-    laplacianPyr.push_back(layer1New);
+    for (int i = 0; i < n; i++) {
+        schar value = (schar)(src1[i] * weights[i] + src2[i] * (1 - weights[i]));
+        dst[i] = saturate_cast<uchar>(dst[i] + value);
+    }
 }
 
-Mat ImagePyramid::addMaskedLaplacian(
+/*
+ * Blends the rows of mask tiles in the range. Each tile row
+ * writes its own rows of the combined image, so stripes of tile
+ * rows run in parallel.
+ */
+class MaskedBlender : public ParallelLoopBody
+{
+public:
+    MaskedBlender(const Mat &src1, const Mat &src2,
+                  const BlendMask &src1Mask, int layer,
+                  const Mat &combined, bool accumulate,
+                  const Point &offset, const Mat &regions,
+                  int tileSize, ImagePyramid::BlendKernel kernel) :
+        src1(src1), src2(src2), src1Mask(src1Mask), layer(layer),
+        combined(combined), accumulate(accumulate), offset(offset),
+        regions(regions), tileSize(tileSize), kernel(kernel) {}
+
+    void operator()(const Range &range) const {
+
+        // mask values of rows that are not stored, and the
+        // values expanded to every channel
+        std::vector<float> maskBuf(src1.cols);
+        std::vector<float> weightBuf;
+
+        int channels = src1.channels();
+        size_t pixelSize = src1.elemSize();
+        bool expanded = kernel == ImagePyramid::BLEND_KERNEL_EXPANDED;
+        if (expanded) {
+            weightBuf.resize(src1.cols * channels);
+        }
+
+        for (int ty = range.start; ty < range.end; ty++) {
+
+            int rowStart = ty * tileSize;
+            int rowEnd = min(rowStart + tileSize, src1.rows);
+            const uchar *tileRegions = regions.ptr<uchar>(ty);
+
+            // merge neighbouring tiles of the same region into one span
+            int tx = 0;
+            while (tx < regions.cols) {
+                uchar region = tileRegions[tx];
+                int spanEnd = tx + 1;
+                while (spanEnd < regions.cols && tileRegions[spanEnd] == region) {
+                    spanEnd++;
+                }
+
+                int colStart = tx * tileSize;
+                int colEnd = min(spanEnd * tileSize, src1.cols);
+                int cols = colEnd - colStart;
+                int n = cols * channels;
+
+                for (int row = rowStart; row < rowEnd; row++) {
+                    uchar *dst = (uchar *) combined.ptr(row) + colStart * pixelSize;
+
+                    const float *maskRow = NULL;
+                    if (region == ImagePyramid::REGION_MIXED) {
+                        maskRow = src1Mask.getRow(
+                                    layer, offset.y + row, offset.x + colStart, cols,
+                                    maskBuf.data());
+                        if (expanded) {
+                            expandSpan(maskRow, weightBuf.data(), cols, channels);
+                        }
+                    }
+                    const float *weights = weightBuf.data();
+
+                    if (accumulate) {
+                        const schar *row1 = src1.ptr<schar>(row) + colStart * channels;
+                        const schar *row2 = src2.ptr<schar>(row) + colStart * channels;
+
+                        if (region == ImagePyramid::REGION_SRC1) {
+                            addSpan(row1, dst, n);
+                        }
+                        else if (region == ImagePyramid::REGION_SRC2) {
+                            addSpan(row2, dst, n);
+                        }
+                        else if (expanded) {
+                            blendAddSpanExpanded(row1, row2, weights, dst, n);
+                        }
+                        else {
+                            blendAddSpan(row1, row2, maskRow, dst, cols, channels);
+                        }
+                    }
+                    else if (region == ImagePyramid::REGION_SRC1) {
+                        memcpy(dst, src1.ptr(row) + colStart * pixelSize, cols * pixelSize);
+                    }
+                    else if (region == ImagePyramid::REGION_SRC2) {
+                        memcpy(dst, src2.ptr(row) + colStart * pixelSize, cols * pixelSize);
+                    }
+                    // signed type
+                    else if (src1.depth() == CV_8S) {
+                        const schar *row1 = src1.ptr<schar>(row) + colStart * channels;
+                        const schar *row2 = src2.ptr<schar>(row) + colStart * channels;
+                        if (expanded) {
+                            blendSpanExpanded(row1, row2, weights, (schar *) dst, n);
+                        }
+                        else {
+                            blendSpan(row1, row2, maskRow, (schar *) dst, cols, channels);
+                        }
+                    }
+                    // unsigned type
+                    else {
+                        const uchar *row1 = src1.ptr<uchar>(row) + colStart * channels;
+                        const uchar *row2 = src2.ptr<uchar>(row) + colStart * channels;
+                        if (expanded) {
+                            blendSpanExpanded(row1, row2, weights, dst, n);
+                        }
+                        else {
+                            blendSpan(row1, row2, maskRow, dst, cols, channels);
+                        }
+                    }
+                }
+
+                tx = spanEnd;
+            }
+        }
+    }
+
+private:
+    const Mat &src1;
+    const Mat &src2;
+    const BlendMask &src1Mask;
+    int layer;
+    Mat combined;       // shares the data of the output
+    bool accumulate;
+    Point offset;
+    const Mat &regions;
+    int tileSize;
+    ImagePyramid::BlendKernel kernel;
+};
+
+void ImagePyramid::addMaskedLaplacian(
         const Mat &src1, const Mat &src2,
-        const Mat &src1Mask) const {
+        const BlendMask &src1Mask, int layer,
+        Mat &combined, bool accumulate,
+        const Point &offset) {
 
     assert(!src1.empty() && !src2.empty() && !src1Mask.empty());
     assert(src1.rows == src2.rows && src1.cols == src2.cols);
-    assert(src1Mask.rows == src1.rows && src1Mask.cols == src1.cols);
 
-    Mat combined;
+    // the area of the layer the sources are
+    Rect area(offset, src1.size());
+    assert((area & Rect(Point(0, 0), src1Mask.getSize(layer))) == area);
 
     // assert left and right are same size
     assert(src1.rows == src2.rows);
@@ -176,63 +1278,106 @@ Mat ImagePyramid::addMaskedLaplacian(
     assert(src1.channels() == src2.channels());
     assert(src1.type() == src2.type());
     assert(src1.channels() == 3);
-    assert(src1Mask.type() == CV_32FC1);
+    assert(src1.depth() == CV_8S || src1.depth() == CV_8U);
 
-    // create dst of same size as left and right
-    combined.create(src1.rows, src1.cols, src1.type());
+    if (accumulate) {
+        assert(src1.depth() == CV_8S);
+        assert(combined.size() == src1.size());
+        assert(combined.type() == CV_MAKETYPE(CV_8U, src1.channels()));
+    }
+    else {
+        // create dst of same size as left and right, reusing its
+        // buffer if it already is
+        combined.create(src1.rows, src1.cols, src1.type());
+    }
+
+    // read once, so every stripe uses the same
+    Tuning current = tuning;
+
+    Mat regions = classifyMask(src1Mask, layer, area, current.maskTileSize);
+
+    MaskedBlender blender(
+                src1, src2, src1Mask, layer, combined, accumulate,
+                offset, regions, current.maskTileSize, current.blendKernel);
 
-    for (int col = 0; col < src1.cols; col++) {
-        for (int row = 0; row < src1.rows; row++) {
-            int p = (row * (col+1) + col);
+    if (current.stripeTiles > 0 && regions.rows > current.stripeTiles) {
+        int stripes = (regions.rows + current.stripeTiles - 1) / current.stripeTiles;
+        parallel_for_(Range(0, regions.rows), blender, stripes);
+    }
+    else {
+        blender(Range(0, regions.rows));
+    }
+}
 
-            // mask values
-            float leftMaskValue = src1Mask.at<float>(row, col); // Error here
-            float rightMaskValue = 1 - leftMaskValue;
+void ImagePyramid::reconstructImage(const LevelCallback &onLevel) {
 
-            // colors of source images
-            Vec3b leftColor = src1.at<Vec3b>(row, col);
-            Vec3b rightColor = src2.at<Vec3b>(row, col);
+    int layers = getLayers();
 
-            // reference for modifying dst image
-            Vec3b & dstColor = combined.at<Vec3b>(row, col);
+    // start with the last layer (should be unsigned)
+    Mat image = laplacianPyr.back();
+    int type = image.type();
 
-            // signed type
-            if (src1.depth() == CV_8S) {
-                dstColor[0] = ((signed char)leftColor[0] * leftMaskValue + (signed char)rightColor[0] * rightMaskValue);
-                dstColor[1] = ((signed char)leftColor[1] * leftMaskValue + (signed char)rightColor[1] * rightMaskValue);
-                dstColor[2] = ((signed char)leftColor[2] * leftMaskValue + (signed char)rightColor[2] * rightMaskValue);
+    if (onLevel) {
+        onLevel(layers-1, image);
+    }
+
+    unshareImage();
+    if (layers == 1) {
+        image.copyTo(this->image);
+    }
+    else {
+        // The Gaussian layers above 0 alternate between the two
+        // parts of the scratch buffer, odd layers first
+        reserveScratch(laplacianPyr);
+        size_t layer1Bytes = laplacianPyr[1].total() * laplacianPyr[1].elemSize();
+
+        // from second last to first
+        for (int layer = layers-2; layer >= 0; layer--) {
+            Mat upscaled;
+            if (layer == 0) {
+                // the last one goes straight into the image
+                this->image.create(laplacianPyr[0].size(), type);
+                upscaled = this->image;
             }
-            // unsigned type
-            else if (src1.depth() == CV_8U) {
-                dstColor[0] = ((uint8_t)leftColor[0] * leftMaskValue + (uint8_t)rightColor[0] * rightMaskValue);
-                dstColor[1] = ((uint8_t)leftColor[1] * leftMaskValue + (uint8_t)rightColor[1] * rightMaskValue);
-                dstColor[2] = ((uint8_t)leftColor[2] * leftMaskValue + (uint8_t)rightColor[2] * rightMaskValue);
+            else {
+                upscaled = levelView(
+                            scratch.buffer, layer % 2 == 1 ? 0 : layer1Bytes,
+                            laplacianPyr[layer].size(), type);
+            }
+
+            // upscale and add previous layer
+            upsample(image, upscaled, upscaled.size(), filter);
+            add(upscaled, laplacianPyr[layer], upscaled, noArray(), type);
+            image = upscaled;
+
+            if (onLevel) {
+                onLevel(layer, image);
             }
         }
     }
 
-    return combined;
+    // set image and resizedImage without using setters. The
+    // getters copy, so they can share the data.
+    this->resizedImage = this->image;
+    this->imageSize = this->image.size();
 
 }
 
-void ImagePyramid::reconstructImage() {
+Mat ImagePyramid::getGaussian(int layer) const {
 
-    Mat image;
-    int layers = getLayers();
+    if (layer < 0 || layer >= getLayers()) {
+        return Mat();   // empty matrix
+    }
 
-    // start with the last layer (should be unsigned)
-    image = laplacianPyr.back();
+    // the last layer is already Gaussian
+    Mat gaussian = laplacianPyr.back().clone();
 
-    // from second last to first
-    for (int layer = layers-2; layer >= 0; layer--) {
-        // upscale and add previous layer
-        pyrUp(image, image);
-        add(image, laplacianPyr[layer], image, noArray(), image.type());
+    for (int l = getLayers()-2; l >= layer; l--) {
+        upsample(gaussian, gaussian, laplacianPyr[l].size(), filter);
+        add(gaussian, laplacianPyr[l], gaussian, noArray(), gaussian.type());
     }
 
-    // set image and resizedImage without using setters
-    this->image = image.clone();
-    this->resizedImage = image.clone();
+    return gaussian;
 
 }
 
@@ -240,7 +1385,7 @@ Mat ImagePyramid::getResizedImage(const Size &size) const{
 
     Mat img;
 
-    resize(image, img, size, INTER_CUBIC);
+    resize(image.empty() ? getImage() : image, img, size, INTER_CUBIC);
 
     return img;
 
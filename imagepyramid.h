@@ -7,16 +7,79 @@
 
 #include <math.h>
 
+#include <functional>
 #include <iostream>
+#include <vector>
+
+#include "blendmask.h"
+#include "memorybudget.h"
 
 using namespace cv;
 
 /**
  * @brief The imagePyramid class
+ *
+ * Copies of a pyramid share its image and layers. The buffers
+ * are reused when the pyramid is rebuilt, but only those no copy
+ * or caller references, so copies stay independent.
  */
 class ImagePyramid
 {
 public:
+    /**
+     * @brief LevelCallback is called with each Gaussian layer
+     * while the image is reconstructed, from the top layer down
+     * to layer 0. The layer is only valid during the call.
+     */
+    typedef std::function<void(int layer, const Mat &gaussian)> LevelCallback;
+
+    /**
+     * @brief The Filter enum is the filter used to go from one
+     * layer to the next. The cheaper filters are faster but
+     * blend with more aliasing.
+     */
+    enum Filter {
+        FILTER_BINOMIAL5,   // 5x5 binomial, OpenCV's pyrDown and pyrUp
+        FILTER_BINOMIAL3,   // 3x3 binomial, linear upsampling
+        FILTER_BOX2         // 2x2 mean, nearest upsampling
+    };
+
+    /**
+     * @brief The MemoryUsage struct is the memory held by a
+     * pyramid, in bytes. Buffers shared with another buffer of
+     * the same pyramid are only counted once.
+     */
+    struct MemoryUsage {
+        size_t image;           // the original or reconstructed image
+        size_t resizedImage;    // 0 if it shares the image
+        std::vector<size_t> levels;
+        size_t scratch;         // working memory
+
+        size_t total() const;
+    };
+
+    /**
+     * @brief The BlendKernel enum is the loop used to blend the
+     * spans of the layers. They give the same result, which is
+     * faster depends on the machine.
+     */
+    enum BlendKernel {
+        BLEND_KERNEL_PIXEL,     // one mask value per pixel
+        BLEND_KERNEL_EXPANDED   // mask expanded to every channel first
+    };
+
+    /**
+     * @brief The Tuning struct holds the settings that change
+     * the speed of building and blending, but not the result.
+     * It is the same for all pyramids in the process.
+     */
+    struct Tuning {
+        int threads;            // OpenCV threads, 0 for its default
+        int maskTileSize;       // width and height of the mask tiles
+        int stripeTiles;        // rows of tiles blended per task, 0 for one thread
+        BlendKernel blendKernel;
+    };
+
     /* Constructors */
     /**
      * @brief imagePyramid creates an imagePyramid with a specified
@@ -31,11 +94,22 @@ public:
      * @param src the image
      */
     ImagePyramid(const Mat &src);
+    /**
+     * @brief imagePyramid creates an imagePyramid from the
+     * layers of a Laplacian pyramid and reconstructs the image
+     * @param laplacianPyr the layers. All but the last are
+     * CV_8S, the last is the Gaussian layer. The data is
+     * shared, not copied, until the pyramid is rebuilt.
+     * @param filter the filter the layers were made with
+     */
+    explicit ImagePyramid(
+            const std::vector<Mat> &laplacianPyr,
+            Filter filter = FILTER_BINOMIAL5);
     /**
      * @brief ImagePyramid default constructor for default
      * constructor purposes.
      */
-    ImagePyramid() {imageSize = Size(512, 512);}
+    ImagePyramid() : filter(FILTER_BINOMIAL5), lean(false), layerTarget(0) {imageSize = Size(512, 512);}
 
     /**
      * @brief imagePyramid creates an imagePyramid by combining
@@ -52,19 +126,110 @@ public:
             const ImagePyramid &src2,
             const Mat &src1Mask
             );
+    /**
+     * @brief imagePyramid creates an imagePyramid by combining
+     * the layers of two imagePyramids using a BlendMask. The
+     * mask levels are computed at each resolution without
+     * materializing a dense mask unless the mask is dense.
+     * @param src1 the first source
+     * @param src2 the second source. Must be the same image
+     * size and number of layers as src1
+     * @param src1Mask the mask for src1. Must be the size of
+     * the sources. The mask for src2 is the inverted mask.
+     */
+    ImagePyramid(
+            const ImagePyramid &src1,
+            const ImagePyramid &src2,
+            const BlendMask &src1Mask
+            );
+
+    /**
+     * @brief blend combines the layers of two imagePyramids
+     * into this one and reconstructs the image. The level
+     * buffers of this pyramid are reused when they have the
+     * right size, so blending frames of the same size again
+     * does not allocate. Copies of this pyramid share those
+     * buffers. In lean mode, or if the blended layers do not
+     * fit in the MemoryBudget, works like blendFused.
+     * @param src1 the first source
+     * @param src2 the second source. Must be the same image
+     * size, number of layers and filter as src1
+     * @param src1Mask the mask for src1. Must be the size of
+     * the sources. The mask for src2 is the inverted mask.
+     * @param onLevel called with each Gaussian layer of the
+     * reconstruction, can be empty
+     */
+    void blend(
+            const ImagePyramid &src1,
+            const ImagePyramid &src2,
+            const BlendMask &src1Mask,
+            const LevelCallback &onLevel = LevelCallback()
+            );
+    /**
+     * @brief blendFused combines two imagePyramids like blend,
+     * but adds each blended layer straight into the
+     * reconstruction, from the top layer down, so the blended
+     * layers are never stored. Afterwards the pyramid only has
+     * the image and getLayers() is 0. Use it when only the
+     * image is needed.
+     * @param src1 the first source
+     * @param src2 the second source. Must be the same image
+     * size, number of layers and filter as src1
+     * @param src1Mask the mask for src1. Must be the size of
+     * the sources. The mask for src2 is the inverted mask.
+     * @param onLevel called with each Gaussian layer of the
+     * reconstruction, can be empty
+     */
+    void blendFused(
+            const ImagePyramid &src1,
+            const ImagePyramid &src2,
+            const BlendMask &src1Mask,
+            const LevelCallback &onLevel = LevelCallback()
+            );
+
+    /**
+     * @brief blendRegion blends and reconstructs only part of
+     * the image of two imagePyramids. Each layer is only
+     * blended and collapsed over the area the region needs,
+     * and layers finer than the scale needs are skipped, so
+     * the time depends on the size of the output, not of the
+     * image.
+     * @param src1 the first source
+     * @param src2 the second source. Must be the same image
+     * size, number of layers and filter as src1
+     * @param src1Mask the mask for src1. Must be the size of
+     * the sources. The levels are computed if it has none, so
+     * pass a mask with levels when calling repeatedly.
+     * @param roi the region of the image
+     * @param scale the size of the output relative to the
+     * region. Below 1/2, the region is reconstructed from a
+     * smaller layer and may be off by part of a pixel of that
+     * layer.
+     * @return the region scaled, empty if the region is
+     * outside the image
+     */
+    static Mat blendRegion(
+            const ImagePyramid &src1,
+            const ImagePyramid &src2,
+            const BlendMask &src1Mask,
+            const Rect &roi,
+            double scale = 1
+            );
 
     /* Getters for image */
     /**
-     * @brief getImage gets the original image
+     * @brief getImage gets the original image. In lean mode the
+     * image is reconstructed from the pyramid, at the size used
+     * for the pyramid.
      * @return the image
      */
-    Mat getImage() const {return image.clone();}
+    Mat getImage() const;
     /**
      * @brief getResizedImage gets the resized image used for the
      * pyramids
      * @return the resized version of the image
      */
-    Mat getResizedImage() const {return resizedImage.clone();}
+    Mat getResizedImage() const;
     /**
      * @brief getResizedImage gets a resized version of the
      * image
@@ -131,6 +296,14 @@ public:
             return laplacianPyr[layer].clone();
         }
     }
+    /**
+     * @brief getGaussian gets the specified layer of the
+     * Gaussian pyramid by collapsing the Laplacian pyramid
+     * from the top layer down to it
+     * @param layer the layer to get
+     * @return the layer. Empty if layer not valid
+     */
+    Mat getGaussian(int layer) const;
 
     /* Layers */
     /**
@@ -139,7 +312,15 @@ public:
      * @return the maximum number of layers possible for the image
      * at the size used
      */
-    unsigned int maxLayers() const {
+    unsigned int maxLayers() const {return maxLayers(getSize());}
+    /**
+     * @brief maxLayers gets the maximum number of layers for
+     * an image pyramid of a size
+     * @param size the size of the image
+     * @return the maximum number of layers possible for the
+     * size
+     */
+    static unsigned int maxLayers(const Size &size) {
 
         //return (int) log2(min(getWidth(), getHeight()));
 
@@ -147,7 +328,7 @@ public:
         // 2 and still and int
 
         unsigned int n = 1; // 0th layer
-        int width = getWidth(), height = getHeight();
+        int width = size.width, height = size.height;
 
         // another pyrDown is possible if
         while (
@@ -171,13 +352,119 @@ public:
     /**
      * @brief setLayers sets the number of layers used. This
      * will automatically change the number of layers in
-     * the Laplacian pyramid.
+     * the Laplacian pyramid. Images set later are built with
+     * the same number of layers, or the most their size allows.
      * @param layers the number of layers to use, must be
      * positive and less than or equal to maxLayers()
      * @return 0 if no error, -1 if too small, 1 if too large
      */
     int setLayers(int layers);
 
+    /* Filter */
+    /**
+     * @brief getFilter gets the filter used between layers
+     * @return the filter
+     */
+    Filter getFilter() const {return filter;}
+    /**
+     * @brief setFilter sets the filter used between layers and
+     * builds the layers again with it. A blended pyramid gets
+     * the filter of its sources.
+     * @param filter the filter
+     */
+    void setFilter(Filter filter);
+    /**
+     * @brief downsample makes the next smaller layer of an
+     * image
+     * @param src the image. Must be CV_8U unless the filter is
+     * FILTER_BINOMIAL5.
+     * @param dst the smaller image
+     * @param size the size of dst, half the size of src
+     * rounded up
+     * @param filter the filter
+     */
+    static void downsample(const Mat &src, Mat &dst, const Size &size, Filter filter);
+    /**
+     * @brief upsample makes the next larger layer of an image
+     * @param src the image. Must be CV_8U unless the filter is
+     * FILTER_BINOMIAL5.
+     * @param dst the larger image, can be src
+     * @param size the size of dst, twice the size of src or
+     * one less
+     * @param filter the filter
+     */
+    static void upsample(const Mat &src, Mat &dst, const Size &size, Filter filter);
+
+    /* Memory */
+    /**
+     * @brief setLean sets whether the pyramid keeps only what
+     * later operations need. A lean pyramid built from an image
+     * keeps only the Laplacian layers, getImage reconstructs
+     * the image. A lean pyramid made by blend keeps only the
+     * image, blend works like blendFused. The working memory
+     * is released after each operation. Applies to the current
+     * data too.
+     * @param lean true for lean mode
+     */
+    void setLean(bool lean);
+    /**
+     * @brief isLean gets whether the pyramid is in lean mode
+     * @return true if in lean mode
+     */
+    bool isLean() const {return lean;}
+    /**
+     * @brief memoryUsage gets the memory held by the pyramid
+     * @return the bytes of each buffer
+     */
+    MemoryUsage memoryUsage() const;
+    /**
+     * @brief estimateMemoryUsage gets the memory a pyramid
+     * built from an image will hold, without building it
+     * @param size the size used for the pyramid
+     * @param type the type of the image
+     * @param lean true for a pyramid in lean mode
+     * @return the bytes of each buffer
+     */
+    static MemoryUsage estimateMemoryUsage(const Size &size, int type, bool lean);
+
+    /* Tuning */
+    /**
+     * @brief defaultTuning gets the tuning used until another
+     * is set
+     * @return the tuning
+     */
+    static Tuning defaultTuning();
+    /**
+     * @brief setTuning sets the tuning of all pyramids, and
+     * the number of OpenCV threads. Must not be called while
+     * pyramids are being blended.
+     * @param tuning the tuning, invalid values are clamped
+     */
+    static void setTuning(const Tuning &tuning);
+    /**
+     * @brief getTuning gets the tuning of all pyramids
+     * @return the tuning
+     */
+    static Tuning getTuning();
+    /**
+     * @brief loadTuning reads a tuning profile and sets it
+     * @param path the path of the profile, a YAML file
+     * @param machine the machine the profile must have been
+     * made on, such as its host name and CPU model
+     * @return 0 if no error, 1 if it could not be read, 2 if it
+     * was made on another machine
+     */
+    static int loadTuning(const std::string &path, const std::string &machine);
+    /**
+     * @brief saveTuning writes the current tuning to a profile.
+     * The profile is written next to the path and renamed, so
+     * readers never see part of it.
+     * @param path the path of the profile, a YAML file
+     * @param machine the machine the tuning was made on
+     * @return 0 if no error, 1 if it could not be written
+     */
+    static int saveTuning(const std::string &path, const std::string &machine);
+
 private:
     Mat image;
 
@@ -186,11 +473,45 @@ private:
 
     std::vector<Mat> laplacianPyr;
 
+    /**
+     * @brief The Scratch struct is working memory for building
+     * and collapsing the pyramid. Copies of the pyramid do not
+     * share it, so they can be used from different threads.
+     */
+    struct Scratch {
+        Mat buffer;
+        Scratch() {}
+        Scratch(const Scratch &) {}
+        Scratch &operator=(const Scratch &) {return *this;}
+    };
+    Scratch scratch;
+
+    Filter filter;
+    bool lean;
+    // the layers built for new images, 0 for the maximum
+    int layerTarget;
+    // The bytes of memoryUsage, counted in the MemoryBudget. A
+    // copy shares the buffers and reserves nothing until it is
+    // rebuilt.
+    MemoryBudget::Reservation reservation;
+
     /**
      * @brief resizeImage sets resizedImage based on imageSize
      */
     void resizeImage() {
-        resize(image, resizedImage, imageSize, INTER_CUBIC);
+        // a lean pyramid does not keep the image
+        if (image.empty() && getLayers() > 0) {
+            image = getGaussian(0);
+        }
+
+        // share the image if it already has the size
+        if (image.size() == imageSize) {
+            resizedImage = image;
+        }
+        else {
+            unshare(resizedImage, !image.empty() && resizedImage.u == image.u ? 2 : 1);
+            resize(image, resizedImage, imageSize, INTER_CUBIC);
+        }
         generatePyramid();
     }
 
@@ -200,6 +521,12 @@ private:
      * up to layers layers
      */
     void generatePyramid();
+    /**
+     * @brief buildLayers builds the layers of the Laplacian
+     * pyramid from resizedImage, the number of layers must be
+     * set and more than 1
+     */
+    void buildLayers();
     /**
      * @brief expandPyramid expands the Laplacian pyramid by 1
      * layer, incrementing layer variable
@@ -210,21 +537,122 @@ private:
      * layer, decrementing the layer variable
      */
     void shrinkPyramid();
+    /**
+     * @brief reserveScratch makes scratch large enough to hold
+     * layer 1 followed by layer 2
+     * @param layers the layers of the pyramid
+     */
+    void reserveScratch(const std::vector<Mat> &layers);
+    /**
+     * @brief scratchBytes gets the size of the working memory
+     * for some layers
+     * @param layers the layers of the pyramid
+     * @return the size in bytes
+     */
+    static size_t scratchBytes(const std::vector<Mat> &layers);
+    /**
+     * @brief levelView creates a header for an image stored in
+     * part of a buffer, without copying
+     * @param buffer the buffer. Must be continuous.
+     * @param offset offset of the image in bytes
+     * @param size size of the image
+     * @param type type of the image
+     * @return the image, sharing the buffer's data
+     */
+    static Mat levelView(
+            const Mat &buffer, size_t offset,
+            const Size &size, int type);
+    /**
+     * @brief releaseUnneeded releases what a lean pyramid does
+     * not keep: the working memory and, if the pyramid has
+     * layers, the images
+     */
+    void releaseUnneeded();
+    /**
+     * @brief unshare releases a buffer that is also referenced
+     * outside the pyramid, so writing to it allocates a new one
+     * instead of changing the data of a copy
+     * @param buffer the buffer
+     * @param references the references the pyramid holds
+     */
+    static void unshare(Mat &buffer, int references = 1);
+    /**
+     * @brief unshareImage unshares image, which resizedImage may
+     * share
+     */
+    void unshareImage() {
+        unshare(image, !image.empty() && resizedImage.u == image.u ? 2 : 1);
+    }
+    /**
+     * @brief unshareLayers unshares the Laplacian layers
+     */
+    void unshareLayers() {
+        for (size_t layer = 0; layer < laplacianPyr.size(); layer++) {
+            unshare(laplacianPyr[layer]);
+        }
+    }
+    /**
+     * @brief updateReservation sets the reservation in the
+     * MemoryBudget to the current memory usage
+     */
+    void updateReservation() {reservation.set(memoryUsage().total());}
+
+    /* Mask regions */
+    // blends the stripes of addMaskedLaplacian
+    friend class MaskedBlender;
+    /**
+     * @brief The MaskRegion enum classifies a tile of a mask
+     * level by which source it takes its pixels from
+     */
+    enum MaskRegion {
+        REGION_SRC2 = 0,    // mask is 0 everywhere, copy src2
+        REGION_SRC1 = 1,    // mask is 1 everywhere, copy src1
+        REGION_MIXED = 2    // fractional weights, blend
+    };
+    /**
+     * @brief classifyMask classifies each square tile of an
+     * area of a mask level as a MaskRegion
+     * @param mask the mask
+     * @param layer the level of the mask. Must be prepared.
+     * @param area the area, the tiles start at its corner
+     * @param tileSize the width and height of the tiles
+     * @return a CV_8UC1 map with one MaskRegion per tile
+     */
+    static Mat classifyMask(
+            const BlendMask &mask, int layer,
+            const Rect &area, int tileSize);
 
     /**
      * @brief addMaskedLaplacian Adds 2 signed or unsigned
-     * images using a mask
+     * images using a mask. Tiles where the mask is constant
+     * are copied from the source, only tiles where the mask
+     * is mixed are blended.
      * @param src1 the first image
      * @param src2 the second image
      * @param src1Mask the mask for the first image. The mask
      * for the second image is this mask inverted
-     * @return the combined image
+     * @param layer the level of the mask to use
+     * @param combined output combined image. Its buffer is
+     * reused if it has the right size and type.
+     * @param accumulate if true, the combined image is added
+     * to combined instead, which must be a CV_8U image of the
+     * size of the sources. The sources must be CV_8S.
+     * @param offset the position of the sources in the layer,
+     * if they are part of it
      */
-    Mat addMaskedLaplacian(
+    static void addMaskedLaplacian(
             const Mat &src1, const Mat &src2,
-            const Mat &src1Mask) const;
+            const BlendMask &src1Mask, int layer,
+            Mat &combined, bool accumulate = false,
+            const Point &offset = Point());
 
-    void reconstructImage();
+    /**
+     * @brief reconstructImage collapses the Laplacian pyramid
+     * and sets image and resizedImage to the result
+     * @param onLevel called with each Gaussian layer, can be
+     * empty
+     */
+    void reconstructImage(const LevelCallback &onLevel = LevelCallback());
 
 
 };
@@ -1,10 +1,18 @@
 #include "mainwindow.h"
+#include "commandline.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    // Run without the window if there are command line options
+    if (isCommandLine(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        return runCommandLine(a);
+    }
+
     QApplication a(argc, argv);
+
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,6 +1,12 @@
 #include "mainwindow.h"
+#include "autotuner.h"
+
+#include <QCoreApplication>
 #include <QFile>
+#include <QMouseEvent>
+#include <QWheelEvent>
 
+#include <cmath>
 #include <iostream>
 
 using namespace cv;
@@ -13,6 +19,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     setWindowTitle("Merging 2 images using Laplacian Pyramids");
 
+    loadTuning();
+
     const QString leftImagePath = ":/images/apple.jpg";
     const QString rightImagePath = ":/images/orange.jpg";
 
@@ -34,14 +42,19 @@ MainWindow::MainWindow(QWidget *parent)
     rightPyr.setLayers(initialLayers);
 
     // Combine them
+    resetView();
     combineImages();
 
     // Display them
     displayImages();
 
+    // zoom and pan the reconstruction with the mouse
+    ui->reconstructionLabel->installEventFilter(this);
+
     // Connect slider changing values to recombining the images
     connect(ui->startSlider, SIGNAL(valueChanged(int)), this, SLOT(combineImages()));
     connect(ui->endSlider, SIGNAL(valueChanged(int)), this, SLOT(combineImages()));
+    connect(ui->seamCheckBox, SIGNAL(toggled(bool)), this, SLOT(combineImages()));
 
     // Connect file selection UI to functionality
     connect(ui->leftFileButton, SIGNAL(clicked()), this, SLOT(handleLeftFileButton()));
@@ -58,6 +71,38 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::loadTuning() {
+
+    if (Autotuner::applyProfile(Autotuner::defaultProfilePath()) == 0) {
+        return;
+    }
+
+    // the default tuning is used until the profile is made
+    tuner = new QProcess(this);
+    tuner->setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(tuner, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(tuningFinished(int, QProcess::ExitStatus)));
+    tuner->start(QCoreApplication::applicationFilePath(), QStringList() << "--retune");
+
+    if (tuner->waitForStarted()) {
+        ui->statusbar->showMessage(tr("Tuning for this machine in the background..."));
+    }
+}
+
+void MainWindow::tuningFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+
+    if (exitStatus == QProcess::NormalExit && exitCode == 0 &&
+            Autotuner::applyProfile(Autotuner::defaultProfilePath()) == 0) {
+        ui->statusbar->showMessage(tr("Tuned for this machine"), 5000);
+    }
+    else {
+        ui->statusbar->showMessage(tr("Could not tune for this machine"), 5000);
+    }
+
+    tuner->deleteLater();
+    tuner = nullptr;
+}
+
 void MainWindow::displayImages() {
 
     Size imSize = leftPyr.getSize();
@@ -102,23 +147,148 @@ void MainWindow::displayImages() {
         }
     }
 
-    Size displaySize = Size(width, height);
+    displaySize = Size(width, height);
 
     // resize the UI components to fit the images if possible
     resizeUI(displaySize);
 
     displayImage(ui->leftImageLabel, leftPyr.getResizedImage(displaySize));
     displayImage(ui->rightImageLabel, rightPyr.getResizedImage(displaySize));
-    displayImage(ui->reconstructionLabel, combinedPyr.getResizedImage(displaySize));
+
+    displayReconstruction();
+}
+
+void MainWindow::displayReconstruction() {
+
+    if (combinedMask.empty() || displaySize.area() == 0) {
+        return;
+    }
+
+    // the view is displayed at the display size, so the time
+    // depends on the display and not on the image
+    Rect2d view = viewRect();
+    double scale = displaySize.width / view.width;
+
+    Rect roi(Point(cvFloor(view.x), cvFloor(view.y)),
+             Point(cvCeil(view.x + view.width), cvCeil(view.y + view.height)));
+
+    int64 start = getTickCount();
+    Mat region = ImagePyramid::blendRegion(leftPyr, rightPyr, combinedMask, roi, scale);
+    double milliseconds = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    if (region.empty()) {
+        return;
+    }
+    if (region.size() != displaySize) {
+        cv::resize(region, region, displaySize);
+    }
+    displayImage(ui->reconstructionLabel, region);
 
     // status bar
     ui->statusbar->showMessage(
                 "Layers Used: " + QString::number(leftPyr.getLayers())
                 + "\t Image size: " + QString::number(leftPyr.getWidth())
                 + " x " + QString::number(leftPyr.getHeight())
+                + "\t Zoom: " + QString::number(zoom, 'f', 2) + "x"
+                + "\t Reconstructed in " + QString::number(milliseconds, 'f', 1) + " ms"
                 );
 }
 
+Rect2d MainWindow::viewRect() const {
+
+    Size imSize = leftPyr.getSize();
+    double width = imSize.width / zoom;
+    double height = imSize.height / zoom;
+
+    // keep the view inside the image
+    double x = min(max(viewCenter.x - width / 2, 0.0), imSize.width - width);
+    double y = min(max(viewCenter.y - height / 2, 0.0), imSize.height - height);
+
+    return Rect2d(x, y, width, height);
+}
+
+void MainWindow::resetView() {
+    Size imSize = leftPyr.getSize();
+    zoom = 1;
+    viewCenter = Point2d(imSize.width / 2.0, imSize.height / 2.0);
+}
+
+void MainWindow::zoomAt(double factor, const QPoint &displayPoint) {
+
+    Rect2d view = viewRect();
+    double scale = view.width / displaySize.width;
+
+    // the image pixel under the point
+    Point2d anchor(view.x + displayPoint.x() * scale,
+                   view.y + displayPoint.y() * scale);
+
+    double newZoom = min(max(zoom * factor, 1.0), maxZoom);
+    double ratio = zoom / newZoom;
+
+    // move the center so the anchor stays under the point
+    Point2d center(view.x + view.width / 2, view.y + view.height / 2);
+    viewCenter = anchor + (center - anchor) * ratio;
+    zoom = newZoom;
+
+    displayReconstruction();
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
+
+    if (watched != ui->reconstructionLabel || displaySize.area() == 0) {
+        return QMainWindow::eventFilter(watched, event);
+    }
+
+    switch (event->type()) {
+    case QEvent::Wheel: {
+        QWheelEvent *wheel = static_cast<QWheelEvent *>(event);
+        int steps = wheel->angleDelta().y() / 120;
+        if (steps != 0) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+            QPoint position = wheel->position().toPoint();
+#else
+            QPoint position = wheel->pos();
+#endif
+            zoomAt(std::pow(zoomStep, steps), position);
+        }
+        return true;
+    }
+    case QEvent::MouseButtonPress: {
+        QMouseEvent *mouse = static_cast<QMouseEvent *>(event);
+        if (mouse->button() == Qt::LeftButton) {
+            dragging = true;
+            dragPosition = mouse->pos();
+        }
+        return true;
+    }
+    case QEvent::MouseMove: {
+        QMouseEvent *mouse = static_cast<QMouseEvent *>(event);
+        if (dragging) {
+            // drag the image with the mouse, starting from the
+            // clamped view so dragging back moves right away
+            Rect2d view = viewRect();
+            double scale = view.width / displaySize.width;
+            QPoint delta = mouse->pos() - dragPosition;
+
+            viewCenter = Point2d(view.x + view.width / 2 - delta.x() * scale,
+                                 view.y + view.height / 2 - delta.y() * scale);
+            dragPosition = mouse->pos();
+            displayReconstruction();
+        }
+        return true;
+    }
+    case QEvent::MouseButtonRelease:
+        dragging = false;
+        return true;
+    case QEvent::MouseButtonDblClick:
+        resetView();
+        displayReconstruction();
+        return true;
+    default:
+        return QMainWindow::eventFilter(watched, event);
+    }
+}
+
 /**
  * Displays an opencv image in a QLabel.
  */
@@ -129,45 +299,45 @@ void MainWindow::displayImage(QLabel *label, Mat img) {
 }
 
 /*
- * Creates a horizontal gradient mask of type CV_32FC1
+ * Creates a horizontal gradient mask. Every row of the mask is
+ * the same, so only one row is stored.
  */
-Mat MainWindow::imageMask(
+BlendMask MainWindow::imageMask(
         int width, int height,
         int startPercent, int endPercent
         ) {
 
-    Mat mask;
+    Mat profile;
 
     int start   = width * startPercent / 100;
     int end     = width * endPercent / 100;
 
-    if (start > end) {
-
-        // If start > end, find mask with start and end swapped, then invert
-        mask = imageMask(width, height, endPercent, startPercent);
-        subtract(1, mask, mask);
-
+    // If start > end, find mask with start and end swapped, then invert
+    bool inverted = start > end;
+    if (inverted) {
+        std::swap(start, end);
     }
-    else {
 
-        // create array
-        mask.create(height, width, CV_32FC1);
+    // create a single row
+    profile.create(1, width, CV_32FC1);
 
-        // fill left and right
-        rectangle(mask, Point(0, 0), Point(start, height-1), 1.0, FILLED);
-        rectangle(mask, Point(end, 0), Point(width-1, height-1), 0.0, FILLED);
+    // fill left and right, start is width at 100 percent
+    profile.colRange(0, min(start + 1, width)).setTo(1.0);
+    profile.colRange(end, width).setTo(0.0);
 
-        // generate gradient between start and end cols
-        for (int col = start; col < end; col++) {
+    // generate gradient between start and end cols
+    for (int col = start; col < end; col++) {
 
-            // linear gradient between start and end
-            float value = (float)(end - col) / (end - start);
-            mask.col(col).setTo(value);
-        }
+        // linear gradient between start and end
+        float value = (float)(end - col) / (end - start);
+        profile.at<float>(0, col) = value;
+    }
 
+    if (inverted) {
+        subtract(1, profile, profile);
     }
 
-    return mask;
+    return BlendMask::separable(profile, height);
 
 }
 
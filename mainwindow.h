@@ -2,9 +2,11 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QProcess>
 
 #include "ui_mainwindow.h"
 #include "imagepyramid.h"
+#include "seamfinder.h"
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -28,11 +30,24 @@ public:
     const Size minDisplayDim = Size(300,700);   // resize to fit
 
     const int displayGap = 20;
-    const int panelHeight = 121;
+    const int panelHeight = 141;
+
+    // how far the reconstruction can be zoomed in, and how much
+    // each step of the mouse wheel zooms
+    const double maxZoom = 32;
+    const double zoomStep = 1.25;
 
     // Width and height used for images
     // const int imageWidth = 512, imageHeight = 512;
 
+protected:
+    /**
+     * @brief eventFilter zooms the reconstruction with the mouse
+     * wheel, pans it by dragging and resets it with a double
+     * click
+     */
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
 private slots:
     void combineImages();
 
@@ -41,6 +56,8 @@ private slots:
     void submitLeftImage();
     void submitRightImage();
 
+    void tuningFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
 private:
     Ui::MainWindow *ui;
 
@@ -56,7 +73,35 @@ private:
     // Image Pyramids
     ImagePyramid leftPyr;
     ImagePyramid rightPyr;
-    ImagePyramid combinedPyr;
+
+    // The mask of the reconstruction, with its levels. Only the
+    // part of the reconstruction in view is blended, each time
+    // it is shown.
+    BlendMask combinedMask;
+
+    // The view of the reconstruction. A zoom of 1 shows the whole
+    // image, the center is in image pixels.
+    double zoom = 1;
+    Point2d viewCenter;
+    Size displaySize;
+
+    // the last mouse position while dragging the view
+    bool dragging = false;
+    QPoint dragPosition;
+
+    // Finds the seam mask when seamCheckBox is checked
+    SeamFinder seamFinder;
+
+    // Tunes for this machine in the background while there is
+    // no profile. It is a separate process, so the tuning of
+    // this one only changes once it is done.
+    QProcess *tuner = nullptr;
+
+    /**
+     * @brief loadTuning loads the tuning profile of this machine,
+     * or starts tuning in the background if there is none
+     */
+    void loadTuning();
 
     /**
      * @brief loadImage Attempts to load an image from a path and returns
@@ -78,6 +123,27 @@ private:
      * the UI to fit
      */
     void displayImages();
+    /**
+     * @brief displayReconstruction blends and displays the part
+     * of the reconstruction in view
+     */
+    void displayReconstruction();
+    /**
+     * @brief viewRect gets the part of the image in view
+     * @return the rectangle in image pixels
+     */
+    Rect2d viewRect() const;
+    /**
+     * @brief resetView shows the whole reconstruction
+     */
+    void resetView();
+    /**
+     * @brief zoomAt changes the zoom, keeping the image pixel under
+     * a point of the display in place
+     * @param factor the factor to multiply the zoom by
+     * @param displayPoint the point on the reconstruction label
+     */
+    void zoomAt(double factor, const QPoint &displayPoint);
     /**
      * @brief resizeUI resizes the UI to fit the size of the images
      * @param imageDimensions the dimenesions of the images
@@ -98,14 +164,15 @@ private:
     void setRightErrorMessage(QString msg);
 
     /**
-     * @brief imageMask generates a mask with a linear gradient.
+     * @brief imageMask generates a mask with a horizontal linear
+     * gradient. The mask is separable, only one row is stored.
      * @param rows number of rows in the mask
      * @param cols number of columns in the mask
      * @param startPercent the start position for the graident
      * @param endPercent the end position for the gradient
      * @return the mask
      */
-    static Mat imageMask(
+    static BlendMask imageMask(
             int width, int height,
             int startPercent, int endPercent
             );
@@ -0,0 +1,60 @@
+#include "memorybudget.h"
+
+#include <atomic>
+
+static std::atomic<size_t> limit(0);
+static std::atomic<size_t> used(0);
+static std::atomic<size_t> peak(0);
+
+MemoryBudget::Reservation::Reservation(const Reservation &) :
+    bytes(0)
+{
+}
+
+MemoryBudget::Reservation &MemoryBudget::Reservation::operator=(
+        const Reservation &) {
+    // the memory counted before belonged to the data replaced
+    set(0);
+    return *this;
+}
+
+void MemoryBudget::Reservation::set(size_t bytes) {
+
+    if (bytes >= this->bytes) {
+        size_t now = used.fetch_add(bytes - this->bytes) + bytes - this->bytes;
+
+        // raise the peak unless another thread raised it higher
+        size_t highest = peak.load();
+        while (now > highest && !peak.compare_exchange_weak(highest, now));
+    }
+    else {
+        used.fetch_sub(this->bytes - bytes);
+    }
+
+    this->bytes = bytes;
+}
+
+void MemoryBudget::setLimit(size_t bytes) {
+    limit = bytes;
+}
+
+size_t MemoryBudget::getLimit() {
+    return limit;
+}
+
+size_t MemoryBudget::getUsed() {
+    return used;
+}
+
+size_t MemoryBudget::getPeak() {
+    return peak;
+}
+
+void MemoryBudget::resetPeak() {
+    peak = used.load();
+}
+
+bool MemoryBudget::fits(size_t bytes) {
+    size_t max = limit;
+    return max == 0 || used + bytes <= max;
+}
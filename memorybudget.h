@@ -0,0 +1,83 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <cstddef>
+
+/**
+ * @brief The MemoryBudget class counts the image memory held in
+ * the process against a limit.
+ *
+ * Pyramids and caches hold a Reservation for the bytes they
+ * keep. Before a large operation they check fits(), and use a
+ * lower memory way of doing it when the extra memory does not
+ * fit. The budget is not enforced, the reservations always
+ * succeed, so the count stays right when nothing fits.
+ */
+class MemoryBudget
+{
+public:
+    /**
+     * @brief The Reservation class holds part of the budget,
+     * released when it is destroyed. A copy, or a reservation
+     * assigned to, reserves nothing. Copies of an owner share
+     * its data, which is counted once, by the original. The
+     * copy sets its reservation when it allocates its own.
+     */
+    class Reservation
+    {
+    public:
+        Reservation() : bytes(0) {}
+        Reservation(const Reservation &other);
+        Reservation &operator=(const Reservation &other);
+        ~Reservation() {set(0);}
+
+        /**
+         * @brief set changes the number of bytes reserved
+         * @param bytes the number of bytes
+         */
+        void set(size_t bytes);
+        /**
+         * @brief get gets the number of bytes reserved
+         * @return the number of bytes
+         */
+        size_t get() const {return bytes;}
+
+    private:
+        size_t bytes;
+    };
+
+    /**
+     * @brief setLimit sets the budget of the process
+     * @param bytes the limit in bytes, 0 for no limit
+     */
+    static void setLimit(size_t bytes);
+    /**
+     * @brief getLimit gets the budget of the process
+     * @return the limit in bytes, 0 if there is no limit
+     */
+    static size_t getLimit();
+    /**
+     * @brief getUsed gets the bytes reserved in the process
+     * @return the number of bytes
+     */
+    static size_t getUsed();
+    /**
+     * @brief getPeak gets the most bytes reserved at the same
+     * time since the last resetPeak
+     * @return the number of bytes
+     */
+    static size_t getPeak();
+    /**
+     * @brief resetPeak sets the peak to the bytes reserved now
+     */
+    static void resetPeak();
+    /**
+     * @brief fits checks if more memory fits in the budget
+     * @param bytes the number of bytes to add
+     * @return true if there is no limit, or if the bytes
+     * reserved plus bytes are not over it
+     */
+    static bool fits(size_t bytes);
+};
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,165 @@
+#include "seamfinder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+int SeamFinder::setBandWidth(int bandWidth) {
+    if (bandWidth <= 0) {
+        return 1;   // error
+    }
+    else {
+        this->bandWidth = bandWidth;
+        return 0;
+    }
+}
+
+std::vector<int> SeamFinder::findSeam(
+        const ImagePyramid &src1, const ImagePyramid &src2,
+        int minCol, int maxCol) const {
+
+    assert(src1.getSize() == src2.getSize());
+    assert(src1.getLayers() == src2.getLayers());
+
+    if (minCol > maxCol) {
+        std::swap(minCol, maxCol);
+    }
+
+    int layers = src1.getLayers();
+    int coarse = (coarseLayer < 0 || coarseLayer >= layers) ? layers-1 : coarseLayer;
+
+    Mat gaussian1 = src1.getGaussian(coarse);
+    Mat gaussian2 = src2.getGaussian(coarse);
+
+    // full search over the allowed columns of the coarse layer
+    int coarseMin = max(minCol >> coarse, 0);
+    int coarseMax = min(maxCol >> coarse, gaussian1.cols - 1);
+    std::vector<int> seam = cheapestSeam(
+                gaussian1, gaussian2,
+                std::vector<int>(gaussian1.rows, coarseMin),
+                std::vector<int>(gaussian1.rows, coarseMax));
+
+    // refine in a band around the upscaled seam
+    for (int layer = coarse-1; layer >= 0; layer--) {
+
+        Mat laplacian1 = src1.getLaplacian(layer);
+        Mat laplacian2 = src2.getLaplacian(layer);
+
+        ImagePyramid::upsample(gaussian1, gaussian1, laplacian1.size(), src1.getFilter());
+        add(gaussian1, laplacian1, gaussian1, noArray(), gaussian1.type());
+        ImagePyramid::upsample(gaussian2, gaussian2, laplacian2.size(), src2.getFilter());
+        add(gaussian2, laplacian2, gaussian2, noArray(), gaussian2.type());
+
+        int layerMin = max(minCol >> layer, 0);
+        int layerMax = min(maxCol >> layer, gaussian1.cols - 1);
+
+        std::vector<int> lo(gaussian1.rows), hi(gaussian1.rows);
+        for (int row = 0; row < gaussian1.rows; row++) {
+            int coarseRow = min(row / 2, (int) seam.size() - 1);
+            int center = 2 * seam[coarseRow];
+
+            lo[row] = max(center - bandWidth, layerMin);
+            hi[row] = min(center + bandWidth, layerMax);
+            if (lo[row] > hi[row]) {
+                lo[row] = hi[row] = min(max(center, layerMin), layerMax);
+            }
+        }
+
+        seam = cheapestSeam(gaussian1, gaussian2, lo, hi);
+    }
+
+    return seam;
+}
+
+BlendMask SeamFinder::findMask(
+        const ImagePyramid &src1, const ImagePyramid &src2,
+        int minCol, int maxCol) const {
+
+    std::vector<int> seam = findSeam(src1, src2, minCol, maxCol);
+
+    Mat mask(src1.getSize(), CV_32FC1, Scalar(0.0));
+
+    // src1 left of the seam
+    for (int row = 0; row < mask.rows; row++) {
+        mask.row(row).colRange(0, seam[row]).setTo(1.0);
+    }
+
+    return BlendMask(mask);
+}
+
+std::vector<int> SeamFinder::cheapestSeam(
+        const Mat &img1, const Mat &img2,
+        const std::vector<int> &lo, const std::vector<int> &hi) {
+
+    assert(img1.size() == img2.size());
+    assert(img1.type() == CV_8UC3 && img2.type() == CV_8UC3);
+
+    const float infinity = std::numeric_limits<float>::infinity();
+    int rows = img1.rows;
+
+    // total cost of the cheapest seam ending at each pixel of the
+    // band, and the column of the previous row it came from
+    std::vector< std::vector<float> > total(rows);
+    std::vector< std::vector<int> > from(rows);
+
+    for (int row = 0; row < rows; row++) {
+
+        int width = hi[row] - lo[row] + 1;
+        total[row].resize(width);
+        from[row].resize(width);
+
+        const uchar *p1 = img1.ptr<uchar>(row);
+        const uchar *p2 = img2.ptr<uchar>(row);
+
+        for (int i = 0; i < width; i++) {
+            int col = lo[row] + i;
+
+            // difference summed over the channels
+            float cost = 0;
+            for (int c = 0; c < 3; c++) {
+                cost += std::abs(p1[3*col + c] - p2[3*col + c]);
+            }
+
+            if (row == 0) {
+                total[row][i] = cost;
+                from[row][i] = col;
+                continue;
+            }
+
+            // cheapest connected pixel of the previous row
+            float best = infinity;
+            int bestCol = min(max(col, lo[row-1]), hi[row-1]);
+            for (int prev = col-1; prev <= col+1; prev++) {
+                if (prev < lo[row-1] || prev > hi[row-1]) {
+                    continue;
+                }
+                float value = total[row-1][prev - lo[row-1]];
+                if (value < best) {
+                    best = value;
+                    bestCol = prev;
+                }
+            }
+
+            // bands that do not touch, jump to the nearest column
+            if (best == infinity) {
+                best = total[row-1][bestCol - lo[row-1]];
+            }
+
+            total[row][i] = cost + best;
+            from[row][i] = bestCol;
+        }
+    }
+
+    // backtrack from the cheapest end
+    std::vector<int> seam(rows);
+
+    const std::vector<float> &last = total[rows-1];
+    int col = lo[rows-1] + (int) (std::min_element(last.begin(), last.end()) - last.begin());
+
+    for (int row = rows-1; row >= 0; row--) {
+        seam[row] = col;
+        col = from[row][col - lo[row]];
+    }
+
+    return seam;
+}
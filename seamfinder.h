@@ -0,0 +1,105 @@
+#ifndef SEAMFINDER_H
+#define SEAMFINDER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "blendmask.h"
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The SeamFinder class finds the vertical seam where
+ * two images differ the least and creates a blend mask from it.
+ *
+ * The seam is found with dynamic programming on a coarse
+ * Gaussian level of the pyramids, then refined level by level
+ * in a narrow band around the seam of the coarser level, so
+ * the cost stays close to linear in the image size.
+ */
+class SeamFinder
+{
+public:
+    /**
+     * @brief SeamFinder creates a SeamFinder with the default
+     * band width and the coarsest layer
+     */
+    SeamFinder() : bandWidth(4), coarseLayer(-1) {}
+
+    /**
+     * @brief getBandWidth gets how far the seam can move from
+     * the seam of the coarser level when refining
+     * @return the band width in pixels on each side
+     */
+    int getBandWidth() const {return bandWidth;}
+    /**
+     * @brief setBandWidth sets how far the seam can move from
+     * the seam of the coarser level when refining
+     * @param bandWidth the band width in pixels on each side,
+     * must be positive
+     * @return 0 if no error, 1 if not positive
+     */
+    int setBandWidth(int bandWidth);
+    /**
+     * @brief getCoarseLayer gets the layer the full search is
+     * done on
+     * @return the layer, -1 for the top layer
+     */
+    int getCoarseLayer() const {return coarseLayer;}
+    /**
+     * @brief setCoarseLayer sets the layer the full search is
+     * done on. Layers past the top layer use the top layer.
+     * @param layer the layer, -1 for the top layer
+     */
+    void setCoarseLayer(int layer) {coarseLayer = layer;}
+
+    /**
+     * @brief findSeam finds the column of the seam in each row
+     * of the full size image
+     * @param src1 the left image
+     * @param src2 the right image. Must be the same size and
+     * number of layers as src1
+     * @param minCol the leftmost column the seam can use
+     * @param maxCol the rightmost column the seam can use
+     * @return the column of the seam for each row. Pixels left
+     * of the seam are from src1.
+     */
+    std::vector<int> findSeam(
+            const ImagePyramid &src1, const ImagePyramid &src2,
+            int minCol, int maxCol) const;
+    /**
+     * @brief findMask finds the seam and creates a mask that is
+     * 1 left of the seam and 0 from the seam on
+     * @param src1 the left image
+     * @param src2 the right image. Must be the same size and
+     * number of layers as src1
+     * @param minCol the leftmost column the seam can use
+     * @param maxCol the rightmost column the seam can use
+     * @return the mask for src1
+     */
+    BlendMask findMask(
+            const ImagePyramid &src1, const ImagePyramid &src2,
+            int minCol, int maxCol) const;
+
+private:
+    int bandWidth;
+    int coarseLayer;
+
+    /**
+     * @brief cheapestSeam finds the connected vertical seam with
+     * the smallest total difference between two images, using
+     * only the columns lo[row] to hi[row] of each row
+     * @param img1 the first image, CV_8UC3
+     * @param img2 the second image, CV_8UC3
+     * @param lo the first column searched in each row
+     * @param hi the last column searched in each row
+     * @return the column of the seam for each row
+     */
+    static std::vector<int> cheapestSeam(
+            const Mat &img1, const Mat &img2,
+            const std::vector<int> &lo, const std::vector<int> &hi);
+};
+
+#endif // SEAMFINDER_H
@@ -5,12 +5,22 @@
 
 void MainWindow::combineImages() {
 
-    combinedPyr = ImagePyramid(
-                leftPyr, rightPyr,
-                imageMask(
-                    leftPyr.getWidth(), leftPyr.getHeight(),
-                    ui->startSlider->value(),
-                    ui->endSlider->value()));
+    int width = leftPyr.getWidth(), height = leftPyr.getHeight();
+    int start = ui->startSlider->value(), end = ui->endSlider->value();
+
+    if (ui->seamCheckBox->isChecked()) {
+        // seam between the start and end of the gradient
+        combinedMask = seamFinder.findMask(
+                    leftPyr, rightPyr,
+                    width * start / 100, width * end / 100);
+    }
+    else {
+        combinedMask = imageMask(width, height, start, end);
+    }
+
+    // the levels are kept, only the part in view is blended when
+    // the view changes
+    combinedMask.setLevels(leftPyr.getLayers());
 
     displayImages();
 }
@@ -79,6 +89,8 @@ void MainWindow::submitLeftImage() {
     // set right image size
     rightPyr.setSize(leftPyr.getSize());
 
+    // the size may have changed
+    resetView();
     combineImages();
     displayImages();
 
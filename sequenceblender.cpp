@@ -0,0 +1,274 @@
+#include "sequenceblender.h"
+
+#include <algorithm>
+#include <thread>
+
+SequenceBlender::SequenceBlender() :
+    layers(0),
+    keyframeStart(0), keyframeEnd(0),
+    freeFrames(frameSlots),
+    decodedFrames(frameSlots),
+    builtFrames(frameSlots),
+    blendedFrames(frameSlots),
+    error(0),
+    frames(0),
+    seconds(0)
+{
+    std::fill(stageSeconds, stageSeconds + STAGES, 0.0);
+}
+
+int SequenceBlender::open(const std::string &src1Path, const std::string &src2Path) {
+    if (!capture1.open(src1Path)) {
+        return 1;
+    }
+    if (!capture2.open(src2Path)) {
+        capture1.release();
+        return 2;
+    }
+    return 0;
+}
+
+int SequenceBlender::setLayers(int layers) {
+    if (layers < 0) {
+        return 1;   // error
+    }
+    else {
+        this->layers = layers;
+        return 0;
+    }
+}
+
+void SequenceBlender::setMask(const BlendMask &mask) {
+    fixedMask = mask;
+    keyframes.clear();
+}
+
+void SequenceBlender::addKeyframe(int frame, float startPercent, float endPercent) {
+
+    fixedMask = BlendMask();
+
+    Keyframe keyframe = {frame, startPercent, endPercent};
+
+    // keep the keyframes sorted by frame
+    std::vector<Keyframe>::iterator it = keyframes.begin();
+    while (it != keyframes.end() && it->frame <= frame) {
+        it++;
+    }
+    keyframes.insert(it, keyframe);
+}
+
+int SequenceBlender::run() {
+
+    if (!capture1.isOpened() || !capture2.isOpened()) {
+        return 1;
+    }
+
+    error = 0;
+    frames = 0;
+    std::fill(stageSeconds, stageSeconds + STAGES, 0.0);
+
+    // the frames are reused for the whole sequence
+    std::vector<Frame> slots(frameSlots);
+    for (size_t i = 0; i < slots.size(); i++) {
+        freeFrames.push(&slots[i]);
+    }
+
+    int64 start = getTickCount();
+
+    std::thread decodeThread(&SequenceBlender::decodeFrames, this);
+    std::thread buildThread(&SequenceBlender::runStage, this,
+                            BUILD, &SequenceBlender::buildPyramids);
+    std::thread blendThread(&SequenceBlender::runStage, this,
+                            BLEND, &SequenceBlender::blendFrame);
+    std::thread encodeThread(&SequenceBlender::runStage, this,
+                             ENCODE, &SequenceBlender::encodeFrame);
+
+    decodeThread.join();
+    buildThread.join();
+    blendThread.join();
+    encodeThread.join();
+
+    seconds = (getTickCount() - start) / getTickFrequency();
+
+    writer.release();
+
+    // every frame is back in the free queue
+    for (size_t i = 0; i < slots.size(); i++) {
+        freeFrames.pop();
+    }
+
+    return error;
+}
+
+void SequenceBlender::decodeFrames() {
+
+    for (int index = 0; error == 0; index++) {
+        Frame *frame = freeFrames.pop();
+
+        int64 start = getTickCount();
+        bool read = capture1.read(frame->src1) && capture2.read(frame->src2);
+        stageSeconds[DECODE] += (getTickCount() - start) / getTickFrequency();
+
+        // either source ended
+        if (!read || frame->src1.empty() || frame->src2.empty()) {
+            freeFrames.push(frame);
+            break;
+        }
+
+        frame->index = index;
+        decodedFrames.push(frame);
+    }
+
+    decodedFrames.push(NULL);
+}
+
+void SequenceBlender::runStage(Stage stage, void (SequenceBlender::*work)(Frame *)) {
+
+    BoundedQueue<Frame *> &in = stage == BUILD ? decodedFrames
+                              : stage == BLEND ? builtFrames
+                              : blendedFrames;
+    BoundedQueue<Frame *> &out = stage == BUILD ? builtFrames
+                               : stage == BLEND ? blendedFrames
+                               : freeFrames;
+
+    while (true) {
+        Frame *frame = in.pop();
+
+        // end of the sequence, pass it on
+        if (frame == NULL) {
+            if (stage != ENCODE) {
+                out.push(NULL);
+            }
+            break;
+        }
+
+        // after an error, drain the frames without working on them
+        if (error == 0) {
+            int64 start = getTickCount();
+            try {
+                (this->*work)(frame);
+            }
+            catch (const cv::Exception &) {
+                int none = 0;
+                error.compare_exchange_strong(none, 4);
+            }
+            stageSeconds[stage] += (getTickCount() - start) / getTickFrequency();
+        }
+
+        if (error != 0) {
+            freeFrames.push(frame);
+        }
+        else {
+            out.push(frame);
+        }
+    }
+}
+
+void SequenceBlender::buildPyramids(Frame *frame) {
+
+    frame->pyr1.setImage(frame->src1);
+
+    // the second source uses the size of the first
+    if (frame->pyr2.getLayers() == 0 || frame->pyr2.getSize() != frame->pyr1.getSize()) {
+        frame->pyr2.setImage(frame->src2);
+        frame->pyr2.setSize(frame->pyr1.getSize());
+    }
+    else {
+        frame->pyr2.setImage(frame->src2, false);
+    }
+
+    if (layers > 0) {
+        frame->pyr1.setLayers(layers);
+        frame->pyr2.setLayers(layers);
+    }
+}
+
+void SequenceBlender::blendFrame(Frame *frame) {
+
+    const BlendMask &mask = maskForFrame(
+                frame->index, frame->pyr1.getSize(), frame->pyr1.getLayers());
+
+    if (mask.getSize() != frame->pyr1.getSize()) {
+        int none = 0;
+        error.compare_exchange_strong(none, 3);
+        return;
+    }
+
+    // only the image is encoded
+    frame->blended.blendFused(frame->pyr1, frame->pyr2, mask);
+}
+
+void SequenceBlender::encodeFrame(Frame *frame) {
+
+    Mat image = frame->blended.getImage();
+
+    if (!writer.isOpened()) {
+        double fps = capture1.get(CAP_PROP_FPS);
+        if (fps <= 0) {
+            fps = 25;
+        }
+
+        // image sequences do not use a codec
+        int fourcc = outputPath.find('%') != std::string::npos ?
+                    0 : VideoWriter::fourcc('M', 'J', 'P', 'G');
+
+        if (!writer.open(outputPath, fourcc, fps, image.size())) {
+            int none = 0;
+            error.compare_exchange_strong(none, 2);
+            return;
+        }
+    }
+
+    writer.write(image);
+    frames++;
+}
+
+const BlendMask &SequenceBlender::maskForFrame(int index, const Size &size, int layers) {
+
+    if (!fixedMask.empty()) {
+        // computes the mask levels once for the whole sequence
+        fixedMask.setLevels(layers);
+        return fixedMask;
+    }
+
+    // gradient at the frame, interpolated between keyframes
+    float start = 40, end = 60;
+    if (!keyframes.empty()) {
+        const Keyframe &first = keyframes.front();
+        const Keyframe &last = keyframes.back();
+
+        if (index <= first.frame) {
+            start = first.startPercent;
+            end = first.endPercent;
+        }
+        else if (index >= last.frame) {
+            start = last.startPercent;
+            end = last.endPercent;
+        }
+        else {
+            size_t next = 1;
+            while (keyframes[next].frame <= index) {
+                next++;
+            }
+            const Keyframe &k0 = keyframes[next-1];
+            const Keyframe &k1 = keyframes[next];
+
+            float t = (float) (index - k0.frame) / (k1.frame - k0.frame);
+            start = k0.startPercent + t * (k1.startPercent - k0.startPercent);
+            end = k0.endPercent + t * (k1.endPercent - k0.endPercent);
+        }
+    }
+
+    // keep the mask while the gradient does not change
+    if (keyframeMask.empty() || keyframeMask.getSize() != size ||
+            start != keyframeStart || end != keyframeEnd) {
+        keyframeMask = BlendMask::linearGradient(
+                    size,
+                    Point2f(size.width * start / 100, 0),
+                    Point2f(size.width * end / 100, 0));
+        keyframeStart = start;
+        keyframeEnd = end;
+    }
+
+    return keyframeMask;
+}
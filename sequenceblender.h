@@ -0,0 +1,196 @@
+#ifndef SEQUENCEBLENDER_H
+#define SEQUENCEBLENDER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "blendmask.h"
+#include "boundedqueue.h"
+#include "imagepyramid.h"
+
+using namespace cv;
+
+/**
+ * @brief The SequenceBlender class blends two videos or image
+ * sequences frame by frame.
+ *
+ * Decoding, building the pyramids, blending and reconstructing,
+ * and encoding each run on their own thread, so consecutive
+ * frames are in different stages at the same time. The frames
+ * and their pyramids are reused, so the level buffers and the
+ * mask levels are only allocated for the first frames.
+ */
+class SequenceBlender
+{
+public:
+    /**
+     * @brief The Stage enum is the stages of the pipeline
+     */
+    enum Stage {
+        DECODE,
+        BUILD,      // building the pyramids of both sources
+        BLEND,      // blending and reconstructing
+        ENCODE,
+        STAGES      // number of stages
+    };
+
+    /**
+     * @brief SequenceBlender creates a blender with no sources
+     */
+    SequenceBlender();
+
+    /**
+     * @brief open opens the two sources. A source is a video
+     * file, or a numbered image sequence such as
+     * "frames/img_%04d.png".
+     * @param src1Path path of the first source
+     * @param src2Path path of the second source
+     * @return 0 if no error, 1 if the first source could not be
+     * opened, 2 if the second source could not be opened
+     */
+    int open(const std::string &src1Path, const std::string &src2Path);
+    /**
+     * @brief setOutput sets where the blended frames are written.
+     * A path with a printf style number such as "out_%04d.png"
+     * writes an image sequence, any other path a MJPG video.
+     * @param path the output path
+     */
+    void setOutput(const std::string &path) {outputPath = path;}
+    /**
+     * @brief setLayers sets the number of layers of the pyramids
+     * @param layers the number of layers, 0 for the maximum
+     * @return 0 if no error, 1 if negative
+     */
+    int setLayers(int layers);
+    /**
+     * @brief setMask sets a mask used for every frame. Replaces
+     * the keyframes.
+     * @param mask the mask for the first source. Must be the
+     * size of the frames used for the pyramids.
+     */
+    void setMask(const BlendMask &mask);
+    /**
+     * @brief addKeyframe adds a horizontal linear gradient mask
+     * at a frame. Frames between keyframes interpolate the
+     * gradient. Clears the mask set by setMask.
+     * @param frame the index of the frame
+     * @param startPercent the start position of the gradient
+     * @param endPercent the end position of the gradient
+     */
+    void addKeyframe(int frame, float startPercent, float endPercent);
+
+    /**
+     * @brief run blends all frames until either source ends
+     * @return 0 if no error, 1 if the sources are not open,
+     * 2 if the output could not be opened, 3 if the mask is not
+     * the size of the frames, 4 if OpenCV reported an error
+     */
+    int run();
+
+    /* Results of the last run */
+    /**
+     * @brief getFrames gets the number of frames written
+     * @return the number of frames
+     */
+    int getFrames() const {return frames;}
+    /**
+     * @brief getSeconds gets the time the run took
+     * @return the time in seconds
+     */
+    double getSeconds() const {return seconds;}
+    /**
+     * @brief getFramesPerSecond gets the throughput of the run
+     * @return frames written per second
+     */
+    double getFramesPerSecond() const
+    {return seconds > 0 ? frames / seconds : 0;}
+    /**
+     * @brief getStageSeconds gets the time a stage was busy. The
+     * stage with the most time limits the throughput.
+     * @param stage the stage
+     * @return the time in seconds
+     */
+    double getStageSeconds(Stage stage) const {return stageSeconds[stage];}
+
+private:
+    /**
+     * @brief The Frame struct holds a frame and the buffers used
+     * for it while it moves through the pipeline
+     */
+    struct Frame {
+        int index;
+        Mat src1, src2;
+        ImagePyramid pyr1, pyr2;
+        ImagePyramid blended;
+    };
+
+    /**
+     * @brief The Keyframe struct is the gradient at a frame
+     */
+    struct Keyframe {
+        int frame;
+        float startPercent;
+        float endPercent;
+    };
+
+    // number of frames in the pipeline at the same time
+    static const int frameSlots = 4;
+
+    VideoCapture capture1;
+    VideoCapture capture2;
+    VideoWriter writer;
+    std::string outputPath;
+
+    int layers;
+
+    // the mask is kept, with its levels, between frames
+    BlendMask fixedMask;
+    std::vector<Keyframe> keyframes;
+    BlendMask keyframeMask;
+    float keyframeStart, keyframeEnd;
+
+    // queues between the stages, NULL ends the sequence
+    BoundedQueue<Frame *> freeFrames;
+    BoundedQueue<Frame *> decodedFrames;
+    BoundedQueue<Frame *> builtFrames;
+    BoundedQueue<Frame *> blendedFrames;
+
+    std::atomic<int> error;
+    int frames;
+    double seconds;
+    double stageSeconds[STAGES];
+
+    /* Stages, each runs on its own thread */
+    /**
+     * @brief decodeFrames reads frames from both sources until
+     * either ends
+     */
+    void decodeFrames();
+    /**
+     * @brief runStage takes frames from the queue of a stage,
+     * works on them and passes them to the next stage
+     * @param stage the stage, BUILD, BLEND or ENCODE
+     * @param work the work done on each frame
+     */
+    void runStage(Stage stage, void (SequenceBlender::*work)(Frame *));
+
+    /* Work done on each frame */
+    void buildPyramids(Frame *frame);
+    void blendFrame(Frame *frame);
+    void encodeFrame(Frame *frame);
+
+    /**
+     * @brief maskForFrame gets the mask of a frame
+     * @param index the index of the frame
+     * @param size the size of the pyramids
+     * @param layers the number of layers of the pyramids
+     * @return the mask
+     */
+    const BlendMask &maskForFrame(int index, const Size &size, int layers);
+};
+
+#endif // SEQUENCEBLENDER_H